@@ -19,6 +19,8 @@ int process_anim(struct goat3d *goat, struct aiAnimation *aianim);
 static int output_filename(char *buf, int bufsz, const char *fname, const char *suffix);
 static long assimp_time(const struct aiAnimation *anim, double aitime);
 
+static int use_stdout;	/* -c: write to stdout instead of a file, for piping */
+
 int main(int argc, char **argv)
 {
 	int i, num_done = 0;
@@ -40,6 +42,10 @@ int main(int argc, char **argv)
 				conv_targ = CONV_SCENE;
 				break;
 
+			case 'c':
+				use_stdout = 1;
+				break;
+
 			default:
 				fprintf(stderr, "invalid option: %s\n", argv[i]);
 				return 1;
@@ -84,7 +90,7 @@ int convert(const char *infname)
 	bufsz = output_filename(0, 0, infname, "goat3d");
 	outfname = alloca(bufsz);
 	output_filename(outfname, bufsz, infname, "goat3d");
-	printf("converting %s -> %s\n", infname, outfname);
+	fprintf(use_stdout ? stderr : stdout, "converting %s -> %s\n", infname, use_stdout ? "<stdout>" : outfname);
 
 
 	if(!(aiscn = aiImportFile(infname, SCE_PPFLAGS))) {
@@ -114,7 +120,12 @@ int convert(const char *infname)
 		process_node(goat, 0, aiscn->mRootNode->mChildren[i]);
 	}
 
-	goat3d_save(goat, outfname);
+	if(use_stdout) {
+		goat3d_save_file(goat, stdout);
+		fflush(stdout);
+	} else {
+		goat3d_save(goat, outfname);
+	}
 	goat3d_free(goat);
 	aiReleaseImport(aiscn);
 	return 0;
@@ -130,7 +141,7 @@ int convert_anim(const char *infname)
 	bufsz = output_filename(0, 0, infname, "goatanim");
 	outfname = alloca(bufsz);
 	output_filename(outfname, bufsz, infname, "goatanim");
-	printf("converting %s -> %s\n", infname, outfname);
+	fprintf(use_stdout ? stderr : stdout, "converting %s -> %s\n", infname, use_stdout ? "<stdout>" : outfname);
 
 
 	if(!(aiscn = aiImportFile(infname, ANM_PPFLAGS))) {
@@ -150,7 +161,12 @@ int convert_anim(const char *infname)
 		}
 	}
 
-	goat3d_save_anim(goat, outfname);
+	if(use_stdout) {
+		goat3d_save_anim_file(goat, stdout);
+		fflush(stdout);
+	} else {
+		goat3d_save_anim(goat, outfname);
+	}
 	goat3d_free(goat);
 	aiReleaseImport(aiscn);
 	return 0;
@@ -225,6 +241,8 @@ void process_mesh(struct goat3d *goat, struct goat3d_mesh *mesh, struct aiMesh *
 	num_verts = aimesh->mNumVertices;
 	num_faces = aimesh->mNumFaces;
 
+	goat3d_reserve_mesh(mesh, num_verts, num_faces);
+
 	for(i=0; i<num_verts; i++) {
 		struct aiVector3D *v;
 		struct aiColor4D *col;
@@ -78,10 +78,17 @@ bool GoatView::load_scene(const char *fname)
 	if(scene) {
 		close_scene();
 	}
-	if(!(scene = goat3d_create()) || goat3d_load(scene, fname) == -1) {
+	/* go through the scene cache, so that reloading an unchanged scene (to
+	 * load a different animation for instance) doesn't parse it again. We need
+	 * a private copy to load animations into, the cached scene is read-only.
+	 */
+	const goat3d *cached = goat3d_load_cached(fname);
+	if(!cached || !(scene = goat3d_clone(cached))) {
+		goat3d_release_cached(cached);
 		QMessageBox::critical(this, "Error", "Failed to load scene file: " + QString(fname));
 		return false;
 	}
+	goat3d_release_cached(cached);
 
 	float bmin[3], bmax[3];
 	if(goat3d_get_bounds(scene, bmin, bmax) != -1) {
@@ -613,20 +620,20 @@ static void draw_mesh(goat3d_mesh *mesh)
 	int num_verts = goat3d_get_mesh_attrib_count(mesh, GOAT3D_MESH_ATTR_VERTEX);
 
 	glEnableClientState(GL_VERTEX_ARRAY);
-	glVertexPointer(3, GL_FLOAT, 0, goat3d_get_mesh_attribs(mesh, GOAT3D_MESH_ATTR_VERTEX));
+	glVertexPointer(3, GL_FLOAT, 0, goat3d_get_mesh_attribs_const(mesh, GOAT3D_MESH_ATTR_VERTEX));
 
-	float *data;
-	if((data = (float*)goat3d_get_mesh_attribs(mesh, GOAT3D_MESH_ATTR_NORMAL))) {
+	const float *data;
+	if((data = (const float*)goat3d_get_mesh_attribs_const(mesh, GOAT3D_MESH_ATTR_NORMAL))) {
 		glEnableClientState(GL_NORMAL_ARRAY);
 		glNormalPointer(GL_FLOAT, 0, data);
 	}
-	if((data = (float*)goat3d_get_mesh_attribs(mesh, GOAT3D_MESH_ATTR_TEXCOORD))) {
+	if((data = (const float*)goat3d_get_mesh_attribs_const(mesh, GOAT3D_MESH_ATTR_TEXCOORD))) {
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 		glTexCoordPointer(2, GL_FLOAT, 0, data);
 	}
 
-	int *indices;
-	if((indices = goat3d_get_mesh_faces(mesh))) {
+	const int *indices;
+	if((indices = goat3d_get_mesh_faces_const(mesh))) {
 		glDrawElements(GL_TRIANGLES, num_faces * 3, GL_UNSIGNED_INT, indices);
 	} else {
 		glDrawArrays(GL_TRIANGLES, 0, num_verts * 3);
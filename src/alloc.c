@@ -0,0 +1,103 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+
+static void *def_alloc(size_t sz, void *cls);
+static void *def_realloc(void *p, size_t sz, void *cls);
+static void def_free(void *p, void *cls);
+
+struct allocator g3dimpl_allocator = {def_alloc, def_realloc, def_free, 0};
+
+GOAT3DAPI void goat3d_set_allocator(goat3d_alloc_func alloc_func, goat3d_realloc_func realloc_func,
+		goat3d_free_func free_func, void *cls)
+{
+	if(!alloc_func || !realloc_func || !free_func) {
+		alloc_func = def_alloc;
+		realloc_func = def_realloc;
+		free_func = def_free;
+		cls = 0;
+	}
+	g3dimpl_allocator.alloc = alloc_func;
+	g3dimpl_allocator.realloc = realloc_func;
+	g3dimpl_allocator.free = free_func;
+	g3dimpl_allocator.cls = cls;
+}
+
+void *g3dimpl_malloc(size_t sz)
+{
+	return g3dimpl_allocator.alloc(sz, g3dimpl_allocator.cls);
+}
+
+void *g3dimpl_calloc(size_t num, size_t sz)
+{
+	void *p;
+
+	if(sz && num > (size_t)-1 / sz) {
+		return 0;
+	}
+	if((p = g3dimpl_allocator.alloc(num * sz, g3dimpl_allocator.cls))) {
+		memset(p, 0, num * sz);
+	}
+	return p;
+}
+
+void *g3dimpl_realloc(void *p, size_t sz)
+{
+	return g3dimpl_allocator.realloc(p, sz, g3dimpl_allocator.cls);
+}
+
+void g3dimpl_free(void *p)
+{
+	if(p) {
+		g3dimpl_allocator.free(p, g3dimpl_allocator.cls);
+	}
+}
+
+void *g3dimpl_mem_alloc(const struct allocator *mem, size_t sz)
+{
+	if(!mem || !mem->alloc) {
+		return g3dimpl_malloc(sz);
+	}
+	return mem->alloc(sz, mem->cls);
+}
+
+void g3dimpl_mem_free(const struct allocator *mem, void *p)
+{
+	if(!mem || !mem->free) {
+		g3dimpl_free(p);
+	} else if(p) {
+		mem->free(p, mem->cls);
+	}
+}
+
+static void *def_alloc(size_t sz, void *cls)
+{
+	return malloc(sz);
+}
+
+static void *def_realloc(void *p, size_t sz, void *cls)
+{
+	return realloc(p, sz);
+}
+
+static void def_free(void *p, void *cls)
+{
+	free(p);
+}
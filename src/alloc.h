@@ -0,0 +1,43 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_ALLOC_H_
+#define GOAT3D_ALLOC_H_
+
+#include <stddef.h>
+#include "goat3d.h"
+
+struct allocator {
+	goat3d_alloc_func alloc;
+	goat3d_realloc_func realloc;
+	goat3d_free_func free;
+	void *cls;
+};
+
+/* global allocator, used for everything not owned by a scene arena */
+extern struct allocator g3dimpl_allocator;
+
+void *g3dimpl_malloc(size_t sz);
+void *g3dimpl_calloc(size_t num, size_t sz);
+void *g3dimpl_realloc(void *p, size_t sz);
+void g3dimpl_free(void *p);
+
+/* allocation through a specific allocator, or the global one if mem is null */
+void *g3dimpl_mem_alloc(const struct allocator *mem, size_t sz);
+void g3dimpl_mem_free(const struct allocator *mem, void *p);
+
+#endif	/* GOAT3D_ALLOC_H_ */
@@ -0,0 +1,337 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "g3danm.h"
+
+/* longest run of keys considered for removal between two kept keys, bounds
+ * the cost of key reduction on long stretches of interpolatable keys
+ */
+#define MAX_RUN		256
+
+#define SQRT2		1.41421356f
+#define QROT_MAX	32767
+#define QVEC_MAX	65535
+
+static int key_fits(const struct key *k, const struct key *a, const struct key *b, int rot, float tol);
+static void put_u32(unsigned char *p, unsigned long x);
+static unsigned long get_u32(const unsigned char *p);
+static long get_i32(const unsigned char *p);
+static char *base64_encode(const unsigned char *data, int size);
+static int base64_decode(unsigned char *dest, int size, const char *str);
+static int b64val(int c);
+
+int g3dimpl_reduce_keys(struct key *keys, int count, int rot, float tol)
+{
+	int i, j, anchor, nkept;
+
+	if(count <= 2) {
+		return count;
+	}
+
+	/* keys are compacted in place. Kept keys are written at or before the
+	 * current index, so keys from the anchor onwards are never overwritten
+	 * before they're checked.
+	 */
+	anchor = 0;
+	nkept = 1;
+	for(i=1; i<count-1; i++) {
+		int drop = i - anchor < MAX_RUN;
+
+		/* can every key between the anchor and i+1 be reconstructed, if i is dropped? */
+		for(j=anchor+1; drop && j<=i; j++) {
+			drop = key_fits(keys + j, keys + anchor, keys + i + 1, rot, tol);
+		}
+		if(!drop) {
+			keys[nkept++] = keys[i];
+			anchor = i;
+		}
+	}
+	keys[nkept++] = keys[count - 1];
+	return nkept;
+}
+
+/* packed key layout (little endian), structure-of-arrays so that unpacking
+ * runs as simple independent loops:
+ *  - count 32bit key times (msec)
+ *  - 3 arrays of count 16bit quantized values
+ * rotations use the smallest-three encoding: the largest component of the
+ * (unit) quaternion is dropped, after making it positive, and the remaining
+ * three are quantized to 15 bits in [-1/sqrt(2), 1/sqrt(2)]. The index of the
+ * dropped component is stored in the top bits of the first two values.
+ * vectors are quantized to 16 bits in the [vmin, vmax] range of each component.
+ */
+char *g3dimpl_pack_keys(const struct key *keys, int count, int rot, cgm_vec3 *vmin, cgm_vec3 *vmax)
+{
+	int i, j, size;
+	unsigned char *buf, *qptr[3];
+	unsigned int qval[3];
+	char *str;
+
+	size = count * 10;
+	if(!(buf = g3dimpl_malloc(size ? size : 1))) {
+		return 0;
+	}
+	for(i=0; i<3; i++) {
+		qptr[i] = buf + count * 4 + count * 2 * i;
+	}
+
+	if(!rot) {
+		float *lo = &vmin->x, *hi = &vmax->x;
+		cgm_vcons(vmin, 0, 0, 0);
+		cgm_vcons(vmax, 0, 0, 0);
+		for(i=0; i<count; i++) {
+			for(j=0; j<3; j++) {
+				float v = (&keys[i].val.x)[j];
+				if(!i || v < lo[j]) lo[j] = v;
+				if(!i || v > hi[j]) hi[j] = v;
+			}
+		}
+	}
+
+	for(i=0; i<count; i++) {
+		const float *v = &keys[i].val.x;
+		put_u32(buf + i * 4, (unsigned long)keys[i].tm);
+
+		if(rot) {
+			int k, m = 0;
+			float s = 1.0f, len;
+
+			len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + v[3] * v[3]);
+			if(len <= 0.0f) len = 1.0f;
+
+			for(j=1; j<4; j++) {
+				if(fabs(v[j]) > fabs(v[m])) m = j;
+			}
+			if(v[m] < 0.0f) s = -1.0f;
+			s /= len;
+
+			for(j=0, k=0; j<4; j++) {
+				float x;
+				if(j == m) continue;
+				x = (v[j] * s * SQRT2 + 1.0f) * 0.5f;
+				if(x < 0.0f) x = 0.0f;
+				if(x > 1.0f) x = 1.0f;
+				qval[k++] = (unsigned int)(x * QROT_MAX + 0.5f);
+			}
+			qval[0] |= (m & 1) << 15;
+			qval[1] |= (m >> 1) << 15;
+		} else {
+			const float *lo = &vmin->x, *hi = &vmax->x;
+			for(j=0; j<3; j++) {
+				float range = hi[j] - lo[j];
+				float x = range > 0.0f ? (v[j] - lo[j]) / range : 0.0f;
+				qval[j] = (unsigned int)(x * QVEC_MAX + 0.5f);
+			}
+		}
+
+		for(j=0; j<3; j++) {
+			qptr[j][i * 2] = qval[j] & 0xff;
+			qptr[j][i * 2 + 1] = (qval[j] >> 8) & 0xff;
+		}
+	}
+
+	str = base64_encode(buf, size);
+	g3dimpl_free(buf);
+	return str;
+}
+
+int g3dimpl_unpack_keys(struct key *keys, int count, const char *str, int rot,
+		const cgm_vec3 *vmin, const cgm_vec3 *vmax)
+{
+	int i, j;
+	size_t size;
+	unsigned char *buf, *qptr[3];
+	float *fval, *comp[3];
+
+	/* count comes from the file, make sure str can hold that many keys before
+	 * allocating anything: 10 bytes per key, 3 bytes per 4 base64 characters
+	 */
+	if(count <= 0 || (size_t)count > strlen(str) / 4 * 3 / 10) {
+		return -1;
+	}
+	size = (size_t)count * 10;
+	if(size > INT_MAX) {
+		return -1;
+	}
+	if(!(buf = g3dimpl_malloc(size + 4 + (size_t)count * 3 * sizeof *fval))) {
+		return -1;
+	}
+	if(base64_decode(buf, (int)size, str) != (int)size) {
+		g3dimpl_free(buf);
+		return -1;
+	}
+	fval = (float*)(buf + ((size + 3) & ~(size_t)3));
+	for(j=0; j<3; j++) {
+		qptr[j] = buf + (size_t)count * 4 + (size_t)count * 2 * j;
+		comp[j] = fval + (size_t)count * j;
+	}
+
+	/* dequantize each component array in a separate tight loop */
+	for(j=0; j<3; j++) {
+		const unsigned char *q = qptr[j];
+		float *dest = comp[j];
+		if(rot) {
+			for(i=0; i<count; i++) {
+				unsigned int x = (q[i * 2] | (q[i * 2 + 1] << 8)) & 0x7fff;
+				dest[i] = ((float)x / QROT_MAX * 2.0f - 1.0f) / SQRT2;
+			}
+		} else {
+			float lo = (&vmin->x)[j];
+			float scale = ((&vmax->x)[j] - lo) / QVEC_MAX;
+			for(i=0; i<count; i++) {
+				unsigned int x = q[i * 2] | (q[i * 2 + 1] << 8);
+				dest[i] = lo + (float)x * scale;
+			}
+		}
+	}
+
+	for(i=0; i<count; i++) {
+		float *v = &keys[i].val.x;
+		keys[i].tm = get_i32(buf + i * 4);
+
+		if(rot) {
+			int k, m;
+			float sq;
+
+			m = (qptr[0][i * 2 + 1] >> 7) | ((qptr[1][i * 2 + 1] >> 7) << 1);
+			sq = 1.0f - comp[0][i] * comp[0][i] - comp[1][i] * comp[1][i] - comp[2][i] * comp[2][i];
+			for(j=0, k=0; j<4; j++) {
+				v[j] = j == m ? (sq > 0.0f ? sqrt(sq) : 0.0f) : comp[k++][i];
+			}
+		} else {
+			v[0] = comp[0][i];
+			v[1] = comp[1][i];
+			v[2] = comp[2][i];
+			v[3] = 1.0f;
+		}
+	}
+
+	g3dimpl_free(buf);
+	return 0;
+}
+
+/* does interpolating between a and b at the time of k, reproduce k within tol? */
+static int key_fits(const struct key *k, const struct key *a, const struct key *b, int rot, float tol)
+{
+	int i;
+	float t, d0, d1;
+	cgm_vec4 v;
+
+	t = b->tm > a->tm ? (float)(k->tm - a->tm) / (float)(b->tm - a->tm) : 0.0f;
+
+	if(rot) {
+		cgm_qslerp((cgm_quat*)&v, (const cgm_quat*)&a->val, (const cgm_quat*)&b->val, t);
+		for(i=0; i<4; i++) {
+			/* q and -q are the same rotation */
+			d0 = fabs((&v.x)[i] - (&k->val.x)[i]);
+			d1 = fabs((&v.x)[i] + (&k->val.x)[i]);
+			if(d0 > tol && d1 > tol) return 0;
+		}
+		return 1;
+	}
+
+	for(i=0; i<3; i++) {
+		float va = (&a->val.x)[i];
+		float vb = (&b->val.x)[i];
+		if(fabs(va + (vb - va) * t - (&k->val.x)[i]) > tol) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void put_u32(unsigned char *p, unsigned long x)
+{
+	p[0] = x & 0xff;
+	p[1] = (x >> 8) & 0xff;
+	p[2] = (x >> 16) & 0xff;
+	p[3] = (x >> 24) & 0xff;
+}
+
+static unsigned long get_u32(const unsigned char *p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+		((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* sign-extends a 32bit two's complement value, even if long is wider */
+static long get_i32(const unsigned char *p)
+{
+	unsigned long x = get_u32(p);
+	return x & 0x80000000ul ? -(long)(0xfffffffful - x) - 1 : (long)x;
+}
+
+static const char b64chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static char *base64_encode(const unsigned char *data, int size)
+{
+	int i;
+	char *str, *ptr;
+	unsigned long x;
+
+	if(!(str = g3dimpl_malloc((size + 2) / 3 * 4 + 1))) {
+		return 0;
+	}
+	ptr = str;
+
+	for(i=0; i<size; i+=3) {
+		x = (unsigned long)data[i] << 16;
+		if(i + 1 < size) x |= (unsigned long)data[i + 1] << 8;
+		if(i + 2 < size) x |= data[i + 2];
+
+		*ptr++ = b64chars[(x >> 18) & 0x3f];
+		*ptr++ = b64chars[(x >> 12) & 0x3f];
+		*ptr++ = i + 1 < size ? b64chars[(x >> 6) & 0x3f] : '=';
+		*ptr++ = i + 2 < size ? b64chars[x & 0x3f] : '=';
+	}
+	*ptr = 0;
+	return str;
+}
+
+static int b64val(int c)
+{
+	if(c >= 'A' && c <= 'Z') return c - 'A';
+	if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if(c >= '0' && c <= '9') return c - '0' + 52;
+	if(c == '+') return 62;
+	if(c == '/') return 63;
+	return -1;
+}
+
+/* returns the number of bytes decoded, at most size */
+static int base64_decode(unsigned char *dest, int size, const char *str)
+{
+	int c, nbits = 0, count = 0;
+	unsigned long x = 0;
+
+	while(*str && *str != '=' && count < size) {
+		if((c = b64val(*str++)) == -1) {
+			continue;	/* skip whitespace and other junk */
+		}
+		x = (x << 6) | c;
+		if((nbits += 6) >= 8) {
+			nbits -= 8;
+			dest[count++] = (x >> nbits) & 0xff;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,278 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define BLOCK_SIZE	65536
+#define ALIGN		16
+#define ALIGNED(x)	(((x) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;	/* usable size, not including the header */
+	struct allocator mem;	/* allocator this block came from */
+};
+
+#define HDRSZ	ALIGNED(sizeof(struct arena_block))
+
+static struct arena_block *alloc_block(struct arena *a, size_t size);
+
+static pthread_mutex_t ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void g3dimpl_arena_init(struct arena *a)
+{
+	memset(a, 0, sizeof *a);
+}
+
+void g3dimpl_arena_destroy(struct arena *a)
+{
+	struct arena_block *blk;
+	struct allocator mem;
+
+	while(a->blocks) {
+		blk = a->blocks;
+		a->blocks = blk->next;
+		mem = blk->mem;
+		g3dimpl_mem_free(&mem, blk);
+	}
+	a->ptr = a->end = a->last = 0;
+	a->used = a->reserved = 0;
+}
+
+void g3dimpl_arena_clear(struct arena *a)
+{
+	struct arena_block *blk, *keep = 0;
+	struct allocator mem;
+
+	while(a->blocks) {
+		blk = a->blocks;
+		a->blocks = blk->next;
+		if(!keep && blk->size == BLOCK_SIZE && memcmp(&blk->mem, &a->mem, sizeof a->mem) == 0) {
+			keep = blk;
+		} else {
+			mem = blk->mem;
+			g3dimpl_mem_free(&mem, blk);
+		}
+	}
+
+	if((a->blocks = keep)) {
+		keep->next = 0;
+		a->ptr = (char*)keep + HDRSZ;
+		a->end = a->ptr + keep->size;
+		a->reserved = HDRSZ + keep->size;
+	} else {
+		a->ptr = a->end = 0;
+		a->reserved = 0;
+	}
+	a->last = 0;
+	a->used = 0;
+}
+
+struct arena *g3dimpl_arena_create(void)
+{
+	struct arena *a;
+
+	if(!(a = g3dimpl_malloc(sizeof *a))) {
+		return 0;
+	}
+	g3dimpl_arena_init(a);
+	a->refcnt = 1;
+	return a;
+}
+
+struct arena *g3dimpl_arena_ref(struct arena *a)
+{
+	pthread_mutex_lock(&ref_lock);
+	a->refcnt++;
+	pthread_mutex_unlock(&ref_lock);
+	return a;
+}
+
+void g3dimpl_arena_release(struct arena *a)
+{
+	int last;
+
+	if(!a) return;
+
+	pthread_mutex_lock(&ref_lock);
+	last = --a->refcnt <= 0;
+	pthread_mutex_unlock(&ref_lock);
+
+	if(last) {
+		g3dimpl_arena_destroy(a);
+		g3dimpl_free(a);
+	}
+}
+
+int g3dimpl_arena_shared(struct arena *a)
+{
+	int res;
+
+	pthread_mutex_lock(&ref_lock);
+	res = a->refcnt > 1;
+	pthread_mutex_unlock(&ref_lock);
+	return res;
+}
+
+void g3dimpl_arena_mark(struct arena *a, struct arena_mark *m)
+{
+	m->blocks = a->blocks;
+	m->next = a->blocks ? a->blocks->next : 0;
+	m->ptr = a->ptr;
+	m->end = a->end;
+	m->last = a->last;
+	m->used = a->used;
+	m->reserved = a->reserved;
+}
+
+void g3dimpl_arena_rollback(struct arena *a, const struct arena_mark *m)
+{
+	struct arena_block *blk;
+	struct allocator mem;
+
+	/* new blocks are either pushed in front of the marked head block, or
+	 * (large allocations) linked right behind the head block of the time
+	 */
+	while(a->blocks != m->blocks) {
+		blk = a->blocks;
+		a->blocks = blk->next;
+		mem = blk->mem;
+		g3dimpl_mem_free(&mem, blk);
+	}
+	if(m->blocks) {
+		while(m->blocks->next != m->next) {
+			blk = m->blocks->next;
+			m->blocks->next = blk->next;
+			mem = blk->mem;
+			g3dimpl_mem_free(&mem, blk);
+		}
+	}
+	a->ptr = m->ptr;
+	a->end = m->end;
+	a->last = m->last;
+	a->used = m->used;
+	a->reserved = m->reserved;
+}
+
+void *g3dimpl_arena_alloc(struct arena *a, size_t sz)
+{
+	struct arena_block *blk;
+	char *p;
+
+	sz = ALIGNED(sz ? sz : 1);
+
+	if(sz > (size_t)(a->end - a->ptr)) {
+		if(sz > BLOCK_SIZE / 4) {
+			/* large allocations get a block of their own, linked behind the
+			 * current one, so that the rest of the current block isn't wasted
+			 */
+			if(!(blk = alloc_block(a, sz))) {
+				return 0;
+			}
+			if(a->blocks) {
+				blk->next = a->blocks->next;
+				a->blocks->next = blk;
+			} else {
+				a->blocks = blk;
+			}
+			a->used += sz;
+			return (char*)blk + HDRSZ;
+		}
+
+		if(!(blk = alloc_block(a, BLOCK_SIZE))) {
+			return 0;
+		}
+		blk->next = a->blocks;
+		a->blocks = blk;
+		a->ptr = (char*)blk + HDRSZ;
+		a->end = a->ptr + BLOCK_SIZE;
+	}
+
+	p = a->ptr;
+	a->ptr += sz;
+	a->last = p;
+	a->used += sz;
+	return p;
+}
+
+void *g3dimpl_arena_realloc(struct arena *a, void *p, size_t oldsz, size_t newsz)
+{
+	void *newp;
+
+	if(!p) {
+		return g3dimpl_arena_alloc(a, newsz);
+	}
+	if(p == a->last && ALIGNED(newsz) <= (size_t)(a->end - a->last)) {
+		a->used -= a->ptr - a->last;
+		a->ptr = a->last + ALIGNED(newsz ? newsz : 1);
+		a->used += a->ptr - a->last;
+		return p;
+	}
+	if(newsz <= oldsz) {
+		return p;
+	}
+
+	if(!(newp = g3dimpl_arena_alloc(a, newsz))) {
+		return 0;
+	}
+	memcpy(newp, p, oldsz);
+	return newp;
+}
+
+void *g3dimpl_aalloc(struct arena *a, size_t sz)
+{
+	return a ? g3dimpl_arena_alloc(a, sz) : g3dimpl_malloc(sz);
+}
+
+void *g3dimpl_arealloc(struct arena *a, void *p, size_t oldsz, size_t newsz)
+{
+	return a ? g3dimpl_arena_realloc(a, p, oldsz, newsz) : g3dimpl_realloc(p, newsz);
+}
+
+void g3dimpl_afree(struct arena *a, void *p)
+{
+	if(!a) g3dimpl_free(p);
+}
+
+char *g3dimpl_astrdup(struct arena *a, const char *s)
+{
+	char *str;
+	size_t len = strlen(s);
+
+	if(!(str = g3dimpl_aalloc(a, len + 1))) {
+		return 0;
+	}
+	memcpy(str, s, len + 1);
+	return str;
+}
+
+static struct arena_block *alloc_block(struct arena *a, size_t size)
+{
+	struct arena_block *blk;
+
+	if(!(blk = g3dimpl_mem_alloc(&a->mem, HDRSZ + size))) {
+		return 0;
+	}
+	blk->next = 0;
+	blk->size = size;
+	blk->mem = a->mem;
+	a->reserved += HDRSZ + size;
+	return blk;
+}
@@ -0,0 +1,81 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_ARENA_H_
+#define GOAT3D_ARENA_H_
+
+#include <stddef.h>
+#include "alloc.h"
+
+struct arena_block;
+
+/* region allocator: allocations are bump-allocated from large blocks, and are
+ * only released all together by g3dimpl_arena_clear/g3dimpl_arena_destroy.
+ * A zero-initialized arena is valid and empty.
+ */
+struct arena {
+	struct arena_block *blocks;	/* current block first */
+	char *ptr, *end;			/* free space in the current block */
+	char *last;					/* most recent allocation, can grow in place */
+	size_t used, reserved;		/* bytes allocated and bytes in blocks */
+	struct allocator mem;		/* block allocator, the global one if unset */
+	int refcnt;					/* only used by g3dimpl_arena_create/release */
+};
+
+void g3dimpl_arena_init(struct arena *a);
+void g3dimpl_arena_destroy(struct arena *a);
+/* releases every allocation, keeping one block around for reuse */
+void g3dimpl_arena_clear(struct arena *a);
+
+/* reference counted arenas, for arena data shared between scenes (see
+ * goat3d_clone). g3dimpl_arena_create returns an empty arena with one owner,
+ * and g3dimpl_arena_release destroys and frees it when the last owner is gone.
+ */
+struct arena *g3dimpl_arena_create(void);
+struct arena *g3dimpl_arena_ref(struct arena *a);
+void g3dimpl_arena_release(struct arena *a);
+/* returns non-zero if the arena has more than one owner */
+int g3dimpl_arena_shared(struct arena *a);
+
+/* allocation state of an arena, see g3dimpl_arena_rollback */
+struct arena_mark {
+	struct arena_block *blocks, *next;
+	char *ptr, *end, *last;
+	size_t used, reserved;
+};
+
+/* g3dimpl_arena_rollback releases everything allocated from the arena since
+ * g3dimpl_arena_mark, for undoing the allocations of a failed operation
+ */
+void g3dimpl_arena_mark(struct arena *a, struct arena_mark *m);
+void g3dimpl_arena_rollback(struct arena *a, const struct arena_mark *m);
+
+void *g3dimpl_arena_alloc(struct arena *a, size_t sz);
+/* grows the allocation in place if it's the most recent one, otherwise
+ * allocates a new region and copies the old contents
+ */
+void *g3dimpl_arena_realloc(struct arena *a, void *p, size_t oldsz, size_t newsz);
+
+/* helpers for objects which might live in an arena: when a is null they
+ * fall back to the global allocator
+ */
+void *g3dimpl_aalloc(struct arena *a, size_t sz);
+void *g3dimpl_arealloc(struct arena *a, void *p, size_t oldsz, size_t newsz);
+void g3dimpl_afree(struct arena *a, void *p);
+char *g3dimpl_astrdup(struct arena *a, const char *s);
+
+#endif	/* GOAT3D_ARENA_H_ */
@@ -0,0 +1,250 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include "atom.h"
+#include "alloc.h"
+#include "g3datomic.h"
+
+#define INIT_HTAB_SIZE	64
+#define INIT_NAMES_SIZE	32
+
+/* lookups don't take the lock: tables are only ever published whole, with
+ * release stores, and never modified afterwards except for filling in empty
+ * slots. Tables replaced when growing are kept alive (they're never freed),
+ * since readers might still be going through them.
+ */
+struct atom_htab {
+	int size;
+	struct atom_htab *prev;	/* replaced tables */
+	int slots[1];			/* open addressing hash table of atom + 1, 0 is empty */
+};
+
+struct atom_names {
+	int max;
+	struct atom_names *prev;
+	const char *names[1];	/* atom -> interned string */
+};
+
+static void init(void);
+static int lookup(const char *str);
+static int intern(const char *str);
+static unsigned int hash_str(const char *str);
+static int grow_htab(void);
+static int grow_names(void);
+
+static const char *predef_names[] = {
+	"",
+	GOAT3D_MAT_ATTR_DIFFUSE,
+	GOAT3D_MAT_ATTR_SPECULAR,
+	GOAT3D_MAT_ATTR_SHININESS,
+	GOAT3D_MAT_ATTR_NORMAL,
+	GOAT3D_MAT_ATTR_BUMP,
+	GOAT3D_MAT_ATTR_REFLECTION,
+	GOAT3D_MAT_ATTR_TRANSMISSION,
+	GOAT3D_MAT_ATTR_IOR,
+	GOAT3D_MAT_ATTR_ALPHA
+};
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+/* serializes additions */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct atom_names *names;
+static int num_atoms;
+static struct atom_htab *htab;
+
+GOAT3DAPI int goat3d_atom(const char *str)
+{
+	int res;
+
+	pthread_once(&init_once, init);
+
+	if((res = lookup(str)) == -1) {
+		pthread_mutex_lock(&lock);
+		res = intern(str);
+		pthread_mutex_unlock(&lock);
+	}
+	return res;
+}
+
+GOAT3DAPI const char *goat3d_atom_name(int atom)
+{
+	struct atom_names *nt;
+
+	if(atom >= 0 && atom < NUM_GOAT3D_PREDEF_ATOMS) {
+		return predef_names[atom];
+	}
+
+	pthread_once(&init_once, init);
+
+	/* names is published before num_atoms, so it's at least this big */
+	if(atom < 0 || atom >= g3dimpl_atomic_load(&num_atoms)) {
+		return 0;
+	}
+	nt = g3dimpl_atomic_loadp(&names);
+	return nt->names[atom];
+}
+
+int g3dimpl_find_atom(const char *str)
+{
+	pthread_once(&init_once, init);
+	return lookup(str);
+}
+
+static void init(void)
+{
+	int i;
+
+	/* populate the table with the predefined atoms, to get their fixed indices */
+	pthread_mutex_lock(&lock);
+	if(grow_names() != -1 && grow_htab() != -1) {
+		for(i=0; i<NUM_GOAT3D_PREDEF_ATOMS; i++) {
+			if(intern(predef_names[i]) != i) {
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static int lookup(const char *str)
+{
+	int idx, atom;
+	unsigned int mask;
+	struct atom_htab *tab;
+	struct atom_names *nt;
+
+	if(!(tab = g3dimpl_atomic_loadp(&htab))) {
+		return -1;
+	}
+
+	mask = tab->size - 1;
+	idx = hash_str(str) & mask;
+	while((atom = g3dimpl_atomic_load(tab->slots + idx))) {
+		/* the name is published before the slot, load names after it */
+		nt = g3dimpl_atomic_loadp(&names);
+		if(strcmp(nt->names[atom - 1], str) == 0) {
+			return atom - 1;
+		}
+		idx = (idx + 1) & mask;
+	}
+	return -1;
+}
+
+/* call with the lock held */
+static int intern(const char *str)
+{
+	int idx, len, atom;
+	unsigned int mask;
+	char *newstr;
+
+	if(!htab || !names) return -1;
+
+	if((atom = lookup(str)) >= 0) {
+		return atom;
+	}
+
+	/* keep the load factor under 1/2 */
+	if((num_atoms + 1) * 2 > htab->size && grow_htab() == -1) {
+		return -1;
+	}
+	if(num_atoms >= names->max && grow_names() == -1) {
+		return -1;
+	}
+
+	if(num_atoms < NUM_GOAT3D_PREDEF_ATOMS) {
+		names->names[num_atoms] = predef_names[num_atoms];
+	} else {
+		len = strlen(str);
+		if(!(newstr = g3dimpl_malloc(len + 1))) {
+			return -1;
+		}
+		memcpy(newstr, str, len + 1);
+		names->names[num_atoms] = newstr;
+	}
+	atom = num_atoms;
+	g3dimpl_atomic_store(&num_atoms, atom + 1);
+
+	mask = htab->size - 1;
+	idx = hash_str(str) & mask;
+	while(htab->slots[idx]) {
+		idx = (idx + 1) & mask;
+	}
+	g3dimpl_atomic_store(htab->slots + idx, atom + 1);
+	return atom;
+}
+
+/* FNV-1a */
+static unsigned int hash_str(const char *str)
+{
+	unsigned int h = 2166136261u;
+	while(*str) {
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+	}
+	return h;
+}
+
+/* call with the lock held */
+static int grow_htab(void)
+{
+	int i, idx, newsz;
+	unsigned int mask;
+	struct atom_htab *newtab;
+
+	newsz = htab ? htab->size * 2 : INIT_HTAB_SIZE;
+	if(!(newtab = g3dimpl_calloc(1, offsetof(struct atom_htab, slots) + newsz * sizeof *newtab->slots))) {
+		return -1;
+	}
+	newtab->size = newsz;
+	newtab->prev = htab;
+	mask = newsz - 1;
+
+	for(i=0; i<num_atoms; i++) {
+		idx = hash_str(names->names[i]) & mask;
+		while(newtab->slots[idx]) {
+			idx = (idx + 1) & mask;
+		}
+		newtab->slots[idx] = i + 1;
+	}
+
+	g3dimpl_atomic_storep(&htab, newtab);
+	return 0;
+}
+
+/* call with the lock held */
+static int grow_names(void)
+{
+	int newmax;
+	struct atom_names *nt;
+
+	newmax = names ? names->max * 2 : INIT_NAMES_SIZE;
+	if(!(nt = g3dimpl_malloc(offsetof(struct atom_names, names) + newmax * sizeof *nt->names))) {
+		return -1;
+	}
+	nt->max = newmax;
+	nt->prev = names;
+	if(num_atoms) {
+		memcpy(nt->names, names->names, num_atoms * sizeof *nt->names);
+	}
+
+	g3dimpl_atomic_storep(&names, nt);
+	return 0;
+}
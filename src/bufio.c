@@ -0,0 +1,225 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "bufio.h"
+#include "alloc.h"
+#include "log.h"
+
+#define DEF_BLOCK_SIZE	(1 << 20)
+
+static size_t block_size = DEF_BLOCK_SIZE;
+
+GOAT3DAPI void goat3d_set_io_block_size(size_t sz)
+{
+	block_size = sz;
+}
+
+GOAT3DAPI size_t goat3d_get_io_block_size(void)
+{
+	return block_size;
+}
+
+int g3dimpl_bufio_open(struct bufio *bio, struct goat3d_io *io)
+{
+	memset(bio, 0, sizeof *bio);
+	bio->io = io;
+
+	if((bio->size = block_size) > 0) {
+		if(!(bio->buf = g3dimpl_malloc(bio->size))) {
+			goat3d_logmsg(LOG_WARNING, "failed to allocate %lu byte I/O buffer, falling back to unbuffered I/O\n",
+					(unsigned long)bio->size);
+			bio->size = 0;
+		}
+	}
+	return 0;
+}
+
+int g3dimpl_bufio_close(struct bufio *bio)
+{
+	long unread;
+
+	if(bio->writing) {
+		g3dimpl_bufio_flush(bio);
+	} else if((unread = (long)(bio->len - bio->pos)) > 0 && bio->io->seek) {
+		/* don't leave the stream past the end of what was actually consumed */
+		bio->io->seek(-unread, SEEK_CUR, bio->io->cls);
+	}
+
+	g3dimpl_free(bio->buf);
+	bio->buf = 0;
+	bio->size = bio->pos = bio->len = 0;
+	return bio->err ? -1 : 0;
+}
+
+static int write_all(struct goat3d_io *io, const char *buf, size_t bytes)
+{
+	long wr;
+
+	while(bytes > 0) {
+		if((wr = io->write(buf, bytes, io->cls)) <= 0) {
+			return -1;
+		}
+		buf += wr;
+		bytes -= wr;
+	}
+	return 0;
+}
+
+int g3dimpl_bufio_flush(struct bufio *bio)
+{
+	if(!bio->writing || !bio->len) {
+		return bio->err ? -1 : 0;
+	}
+
+	if(write_all(bio->io, bio->buf, bio->len) == -1) {
+		bio->err = 1;
+	}
+	bio->len = 0;
+	return bio->err ? -1 : 0;
+}
+
+/* switches a read buffer to write mode or vice versa, giving back any unread
+ * read-ahead data, or writing out any pending writes first
+ */
+static int set_mode(struct bufio *bio, int writing)
+{
+	long unread;
+
+	if(bio->writing == writing) return 0;
+
+	if(bio->writing) {
+		if(g3dimpl_bufio_flush(bio) == -1) {
+			return -1;
+		}
+	} else if((unread = (long)(bio->len - bio->pos)) > 0) {
+		if(!bio->io->seek || bio->io->seek(-unread, SEEK_CUR, bio->io->cls) == -1) {
+			return -1;
+		}
+	}
+	bio->pos = bio->len = 0;
+	bio->writing = writing;
+	return 0;
+}
+
+long g3dimpl_bufio_read(void *buf, size_t bytes, void *uptr)
+{
+	struct bufio *bio = uptr;
+	struct goat3d_io *io = bio->io;
+	char *dest = buf;
+	size_t avail, total = 0;
+	long rd = 0;
+
+	if(set_mode(bio, 0) == -1) {
+		return -1;
+	}
+
+	while(bytes > 0) {
+		if((avail = bio->len - bio->pos) > 0) {
+			if(avail > bytes) avail = bytes;
+			memcpy(dest, bio->buf + bio->pos, avail);
+			bio->pos += avail;
+			dest += avail;
+			bytes -= avail;
+			total += avail;
+			continue;
+		}
+
+		if(bytes >= bio->size) {
+			/* large read, don't bother going through the buffer */
+			if((rd = io->read(dest, bytes, io->cls)) <= 0) {
+				break;
+			}
+			dest += rd;
+			bytes -= rd;
+			total += rd;
+			continue;
+		}
+
+		if((rd = io->read(bio->buf, bio->size, io->cls)) <= 0) {
+			break;
+		}
+		bio->pos = 0;
+		bio->len = rd;
+	}
+
+	if(!total && rd < 0) {
+		return -1;
+	}
+	return (long)total;
+}
+
+long g3dimpl_bufio_write(const void *buf, size_t bytes, void *uptr)
+{
+	struct bufio *bio = uptr;
+
+	if(!bytes) return 0;
+	if(bio->err || set_mode(bio, 1) == -1) {
+		return -1;
+	}
+
+	if(bio->len + bytes > bio->size) {
+		if(g3dimpl_bufio_flush(bio) == -1) {
+			return -1;
+		}
+		if(bytes >= bio->size) {
+			if(write_all(bio->io, buf, bytes) == -1) {
+				bio->err = 1;
+				return -1;
+			}
+			return (long)bytes;
+		}
+	}
+
+	memcpy(bio->buf + bio->len, buf, bytes);
+	bio->len += bytes;
+	return (long)bytes;
+}
+
+long g3dimpl_bufio_seek(long offs, int whence, void *uptr)
+{
+	struct bufio *bio = uptr;
+	long cur, unread;
+
+	if(!bio->io->seek) {
+		return -1;
+	}
+
+	if(bio->writing) {
+		if(g3dimpl_bufio_flush(bio) == -1) {
+			return -1;
+		}
+		return bio->io->seek(offs, whence, bio->io->cls);
+	}
+
+	unread = (long)(bio->len - bio->pos);
+	if(whence == SEEK_CUR) {
+		/* relative seeks within the read-ahead buffer don't reach the stream */
+		if(offs >= -(long)bio->pos && offs <= unread) {
+			bio->pos += offs;
+			if((cur = bio->io->seek(0, SEEK_CUR, bio->io->cls)) == -1) {
+				return -1;
+			}
+			return cur - (long)(bio->len - bio->pos);
+		}
+		offs -= unread;
+	}
+
+	bio->pos = bio->len = 0;
+	return bio->io->seek(offs, whence, bio->io->cls);
+}
@@ -0,0 +1,53 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_BUFIO_H_
+#define GOAT3D_BUFIO_H_
+
+#include <stddef.h>
+#include "goat3d.h"
+
+/* buffering layer between the parser/writer and the user goat3d_io callbacks.
+ * Reads are done a whole block at a time (read-ahead), and small writes are
+ * coalesced into blocks, so that the user callbacks are called once per block
+ * instead of once per token. Buffering is bypassed for requests larger than a
+ * block, and entirely if the block size is set to 0.
+ */
+struct bufio {
+	struct goat3d_io *io;
+	char *buf;
+	size_t size;		/* block size */
+	size_t pos, len;	/* read position in buf, and valid bytes in buf */
+	int writing;		/* buf holds pending writes (len bytes) */
+	int err;
+};
+
+int g3dimpl_bufio_open(struct bufio *bio, struct goat3d_io *io);
+/* flushes pending writes, returns the unread part of the read-ahead buffer to
+ * the stream if possible, and releases the buffer. Returns -1 if any write
+ * failed.
+ */
+int g3dimpl_bufio_close(struct bufio *bio);
+
+int g3dimpl_bufio_flush(struct bufio *bio);
+
+/* goat3d_io compatible callbacks, with the bufio as the closure pointer */
+long g3dimpl_bufio_read(void *buf, size_t bytes, void *uptr);
+long g3dimpl_bufio_write(const void *buf, size_t bytes, void *uptr);
+long g3dimpl_bufio_seek(long offs, int whence, void *uptr);
+
+#endif	/* GOAT3D_BUFIO_H_ */
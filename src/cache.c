@@ -0,0 +1,263 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "log.h"
+
+#define DEF_BUDGET	(128 * 1024 * 1024)
+
+/* scenes are identified by the file they were loaded from, rather than by
+ * the path used to get to it, and a modified file never matches a stale entry
+ */
+struct file_id {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+};
+
+struct cache_entry {
+	struct file_id id;
+	struct goat3d *g;
+	size_t bytes;
+	int refcnt;
+	int stale;	/* file changed, drop as soon as it's no longer in use */
+	struct cache_entry *prev, *next;
+};
+
+/* entries in most recently used first order */
+static struct cache_entry *head, *tail;
+static size_t cache_bytes, budget = DEF_BUDGET;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int get_file_id(const char *fname, struct file_id *id);
+static struct cache_entry *find_entry(const struct file_id *id);
+static void link_front(struct cache_entry *e);
+static void unlink_entry(struct cache_entry *e);
+static void free_entry(struct cache_entry *e);
+static void evict(void);
+
+GOAT3DAPI const struct goat3d *goat3d_load_cached(const char *fname)
+{
+	struct file_id id;
+	struct cache_entry *e, *other;
+	struct goat3d *g;
+	struct goat3d_memory_stats stats;
+	float bmin[3], bmax[3];
+
+	if(get_file_id(fname, &id) == -1) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&cache_lock);
+	if((e = find_entry(&id))) {
+		e->refcnt++;
+		unlink_entry(e);
+		link_front(e);
+		pthread_mutex_unlock(&cache_lock);
+		return e->g;
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	/* load without holding the lock, so that cache hits aren't blocked behind
+	 * the load of an unrelated file
+	 */
+	if(!(g = goat3d_create())) {
+		return 0;
+	}
+	if(goat3d_load(g, fname) == -1) {
+		goat3d_free(g);
+		return 0;
+	}
+	/* the scene is read-only from now on, compute the bounds while it's still
+	 * ours alone
+	 */
+	goat3d_get_bounds(g, bmin, bmax);
+
+	if(!(e = g3dimpl_malloc(sizeof *e))) {
+		goat3d_free(g);
+		return 0;
+	}
+	goat3d_get_memory_stats(g, &stats);
+	e->id = id;
+	e->g = g;
+	e->bytes = stats.total.reserved;
+	e->refcnt = 1;
+	e->stale = 0;
+
+	pthread_mutex_lock(&cache_lock);
+	if((other = find_entry(&id))) {
+		/* someone else loaded the same file in the meantime, use theirs */
+		other->refcnt++;
+		unlink_entry(other);
+		link_front(other);
+		pthread_mutex_unlock(&cache_lock);
+		free_entry(e);
+		return other->g;
+	}
+
+	/* older versions of the same file will never be hit again */
+	for(other=head; other; other=other->next) {
+		if(other->id.dev == id.dev && other->id.ino == id.ino) {
+			other->stale = 1;
+		}
+	}
+
+	link_front(e);
+	cache_bytes += e->bytes;
+	evict();
+	pthread_mutex_unlock(&cache_lock);
+	return g;
+}
+
+GOAT3DAPI void goat3d_release_cached(const struct goat3d *g)
+{
+	struct cache_entry *e;
+
+	if(!g) return;
+
+	pthread_mutex_lock(&cache_lock);
+	for(e=head; e; e=e->next) {
+		if(e->g == g) break;
+	}
+	if(!e) {
+		pthread_mutex_unlock(&cache_lock);
+		goat3d_logmsg(LOG_WARNING, "goat3d_release_cached: scene %s is not in the cache\n", g->name);
+		return;
+	}
+	if(--e->refcnt <= 0) {
+		evict();
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+GOAT3DAPI void goat3d_set_cache_budget(size_t bytes)
+{
+	pthread_mutex_lock(&cache_lock);
+	budget = bytes;
+	evict();
+	pthread_mutex_unlock(&cache_lock);
+}
+
+GOAT3DAPI void goat3d_flush_cache(void)
+{
+	struct cache_entry *e, *next;
+
+	pthread_mutex_lock(&cache_lock);
+	e = head;
+	while(e) {
+		next = e->next;
+		if(e->refcnt <= 0) {
+			unlink_entry(e);
+			cache_bytes -= e->bytes;
+			free_entry(e);
+		} else {
+			e->stale = 1;
+		}
+		e = next;
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static int get_file_id(const char *fname, struct file_id *id)
+{
+	struct stat st;
+
+	if(stat(fname, &st) == -1) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_load_cached: failed to stat \"%s\"\n", fname);
+		return -1;
+	}
+	memset(id, 0, sizeof *id);
+	id->dev = st.st_dev;
+	id->ino = st.st_ino;
+	id->mtime = st.st_mtime;
+	id->size = st.st_size;
+	return 0;
+}
+
+static struct cache_entry *find_entry(const struct file_id *id)
+{
+	struct cache_entry *e = head;
+
+	while(e) {
+		if(!e->stale && e->id.dev == id->dev && e->id.ino == id->ino &&
+				e->id.mtime == id->mtime && e->id.size == id->size) {
+			return e;
+		}
+		e = e->next;
+	}
+	return 0;
+}
+
+static void link_front(struct cache_entry *e)
+{
+	e->prev = 0;
+	e->next = head;
+	if(head) {
+		head->prev = e;
+	} else {
+		tail = e;
+	}
+	head = e;
+}
+
+static void unlink_entry(struct cache_entry *e)
+{
+	if(e->prev) {
+		e->prev->next = e->next;
+	} else {
+		head = e->next;
+	}
+	if(e->next) {
+		e->next->prev = e->prev;
+	} else {
+		tail = e->prev;
+	}
+}
+
+static void free_entry(struct cache_entry *e)
+{
+	goat3d_free(e->g);
+	g3dimpl_free(e);
+}
+
+/* drops unused stale entries, and then unused entries starting from the least
+ * recently used one, until the cache fits in its budget. Entries in use are
+ * never evicted, so the cache might stay over budget until they're released.
+ * Called with the cache lock held.
+ */
+static void evict(void)
+{
+	struct cache_entry *e, *prev;
+
+	e = tail;
+	while(e) {
+		prev = e->prev;
+		if(e->refcnt <= 0 && (e->stale || cache_bytes > budget)) {
+			unlink_entry(e);
+			cache_bytes -= e->bytes;
+			free_entry(e);
+		}
+		e = prev;
+	}
+}
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "goat3d.h"
 #include "chunk.h"
+#include "log.h"
 
 void g3dimpl_chunk_header(struct chunk_header *hdr, int id)
 {
@@ -26,7 +27,13 @@ void g3dimpl_chunk_header(struct chunk_header *hdr, int id)
 
 int g3dimpl_write_chunk_header(const struct chunk_header *hdr, struct goat3d_io *io)
 {
-	io->seek(-(long)hdr->size, SEEK_CUR, io->cls);
+	if(!io->seek) {
+		goat3d_logmsg(LOG_ERROR, "can't patch chunk size on a non-seekable stream\n");
+		return -1;
+	}
+	if(io->seek(-(long)hdr->size, SEEK_CUR, io->cls) == -1) {
+		return -1;
+	}
 	if(io->write(hdr, sizeof *hdr, io->cls) < (long)sizeof *hdr) {
 		return -1;
 	}
@@ -41,7 +48,23 @@ int g3dimpl_read_chunk_header(struct chunk_header *hdr, struct goat3d_io *io)
 	return 0;
 }
 
-void g3dimpl_skip_chunk(const struct chunk_header *hdr, struct goat3d_io *io)
+int g3dimpl_skip_chunk(const struct chunk_header *hdr, struct goat3d_io *io)
 {
-	io->seek(hdr->size - sizeof *hdr, SEEK_CUR, io->cls);
+	char buf[512];
+	long sz, rd;
+
+	sz = hdr->size - sizeof *hdr;
+
+	if(io->seek && io->seek(sz, SEEK_CUR, io->cls) != -1) {
+		return 0;
+	}
+
+	/* not seekable, read and discard the chunk data */
+	while(sz > 0) {
+		if((rd = io->read(buf, sz < (long)sizeof buf ? sz : (long)sizeof buf, io->cls)) <= 0) {
+			return -1;
+		}
+		sz -= rd;
+	}
+	return 0;
 }
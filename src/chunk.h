@@ -137,6 +137,6 @@ struct chunk {
 void g3dimpl_chunk_header(struct chunk_header *hdr, int id);
 int g3dimpl_write_chunk_header(const struct chunk_header *hdr, struct goat3d_io *io);
 int g3dimpl_read_chunk_header(struct chunk_header *hdr, struct goat3d_io *io);
-void g3dimpl_skip_chunk(const struct chunk_header *hdr, struct goat3d_io *io);
+int g3dimpl_skip_chunk(const struct chunk_header *hdr, struct goat3d_io *io);
 
 #endif	/* CHUNK_H_ */
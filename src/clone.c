@@ -0,0 +1,356 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "dynarr.h"
+#include "log.h"
+
+/* source to clone pointer mapping, sorted by source pointer */
+struct ptrmap {
+	const void *src;
+	void *dst;
+};
+
+static struct goat3d_material *clone_mtl(struct goat3d_material *src);
+static struct goat3d_mesh *clone_mesh(struct goat3d_mesh *src);
+static struct object *clone_obj(struct object *src, size_t size);
+static struct goat3d_node *clone_node(struct goat3d_node *src);
+static struct anm_node *reverse_list(struct anm_node *list);
+static int add_map(struct ptrmap **map, const void *src, void *dst);
+static void *lookup(struct ptrmap *map, const void *src);
+static int cmp_ptrmap(const void *a, const void *b);
+
+GOAT3DAPI struct goat3d *goat3d_clone(const struct goat3d *g)
+{
+	int i, j, num, nbones;
+	struct goat3d *cg;
+	struct ptrmap *map = 0;
+	struct goat3d_material *mtl;
+	struct goat3d_mesh *mesh, *srcmesh;
+	struct object *obj;
+	struct goat3d_node *node;
+	struct anm_node *child;
+	struct arena *a;
+
+	if(!(cg = goat3d_create()) || !(map = dynarr_alloc(0, sizeof *map))) {
+		goto err;
+	}
+	cg->flags = g->flags;
+	cg->ambient = g->ambient;
+	if(goat3d_set_name(cg, g->name) == -1) goto err;
+	if(g->search_path && !(cg->search_path = g3dimpl_astrdup(0, g->search_path))) {
+		goto err;
+	}
+
+	/* keep alive every arena holding data we're about to share */
+	a = g3dimpl_arena_ref(g->arena);
+	DYNARR_PUSH(cg->shared_arenas, &a);
+	if(dynarr_size(cg->shared_arenas) < 1) {
+		g3dimpl_arena_release(a);
+		goto err;
+	}
+	num = dynarr_size(g->shared_arenas);
+	for(i=0; i<num; i++) {
+		a = g3dimpl_arena_ref(g->shared_arenas[i]);
+		DYNARR_PUSH(cg->shared_arenas, &a);
+		if(dynarr_size(cg->shared_arenas) < i + 2) {
+			g3dimpl_arena_release(a);
+			goto err;
+		}
+	}
+
+	num = dynarr_size(g->materials);
+	for(i=0; i<num; i++) {
+		if(!(mtl = clone_mtl(g->materials[i]))) goto err;
+		if(goat3d_add_mtl(cg, mtl) == -1) {
+			goat3d_destroy_mtl(mtl);
+			goto err;
+		}
+		if(add_map(&map, g->materials[i], mtl) == -1) goto err;
+	}
+
+	num = dynarr_size(g->meshes);
+	for(i=0; i<num; i++) {
+		if(!(mesh = clone_mesh(g->meshes[i]))) goto err;
+		if(goat3d_add_mesh(cg, mesh) == -1) {
+			goat3d_destroy_mesh(mesh);
+			goto err;
+		}
+		if(add_map(&map, g->meshes[i], mesh) == -1) goto err;
+	}
+
+	num = dynarr_size(g->lights);
+	for(i=0; i<num; i++) {
+		if(!(obj = clone_obj((struct object*)g->lights[i], sizeof *g->lights[i]))) goto err;
+		if(goat3d_add_light(cg, (struct goat3d_light*)obj) == -1) {
+			goat3d_destroy_light((struct goat3d_light*)obj);
+			goto err;
+		}
+		if(add_map(&map, g->lights[i], obj) == -1) goto err;
+	}
+
+	num = dynarr_size(g->cameras);
+	for(i=0; i<num; i++) {
+		if(!(obj = clone_obj((struct object*)g->cameras[i], sizeof *g->cameras[i]))) goto err;
+		if(goat3d_add_camera(cg, (struct goat3d_camera*)obj) == -1) {
+			goat3d_destroy_camera((struct goat3d_camera*)obj);
+			goto err;
+		}
+		if(add_map(&map, g->cameras[i], obj) == -1) goto err;
+	}
+
+	num = dynarr_size(g->nodes);
+	for(i=0; i<num; i++) {
+		if(!(node = clone_node(g->nodes[i]))) goto err;
+		if(goat3d_add_node(cg, node) == -1) {
+			goat3d_destroy_node(node);
+			goto err;
+		}
+		if(add_map(&map, g->nodes[i], node) == -1) goto err;
+	}
+
+	/* fix up references to the cloned materials, objects, and nodes.
+	 * References to anything which isn't part of the source scene are copied
+	 * as they are.
+	 */
+	qsort(map, dynarr_size(map), sizeof *map, cmp_ptrmap);
+
+	num = dynarr_size(cg->meshes);
+	for(i=0; i<num; i++) {
+		mesh = cg->meshes[i];
+		srcmesh = g->meshes[i];
+		if(mesh->mtl && (mtl = lookup(map, mesh->mtl))) {
+			mesh->mtl = mtl;
+		}
+		nbones = dynarr_size(srcmesh->bones);
+		for(j=0; j<nbones; j++) {
+			if((node = lookup(map, srcmesh->bones[j]))) {
+				mesh->bones[j] = &node->anm;
+			}
+		}
+	}
+
+	num = dynarr_size(cg->nodes);
+	for(i=0; i<num; i++) {
+		node = cg->nodes[i];
+		if(node->obj && (obj = lookup(map, node->obj))) {
+			node->obj = obj;
+		}
+
+		child = g->nodes[i]->anm.child;
+		while(child) {
+			struct goat3d_node *cnode = lookup(map, child);
+			if(cnode) {
+				goat3d_add_node_child(node, cnode);
+			} else {
+				goat3d_logmsg(LOG_WARNING, "goat3d_clone: child of node %s is not part of the scene\n",
+						goat3d_get_node_name(g->nodes[i]));
+			}
+			child = child->next;
+		}
+		/* anm_link_node prepends, restore the source child order */
+		node->anm.child = reverse_list(node->anm.child);
+	}
+
+	dynarr_free(map);
+	return cg;
+
+err:
+	goat3d_logmsg(LOG_ERROR, "goat3d_clone: failed to clone scene %s\n", g->name);
+	dynarr_free(map);
+	if(cg) goat3d_free(cg);
+	return 0;
+}
+
+static struct goat3d_material *clone_mtl(struct goat3d_material *src)
+{
+	int i, num;
+	struct goat3d_material *mtl;
+	struct material_attrib *ma;
+
+	if(!(mtl = goat3d_create_mtl())) {
+		return 0;
+	}
+	if(src->name && goat3d_set_mtl_name(mtl, src->name) == -1) {
+		goto err;
+	}
+
+	num = dynarr_size(src->attrib);
+	for(i=0; i<num; i++) {
+		if(!(ma = g3dimpl_mtl_getattr_atom(mtl, src->attrib[i].atom))) {
+			goto err;
+		}
+		ma->value = src->attrib[i].value;
+		if(src->attrib[i].map && !(ma->map = g3dimpl_astrdup(0, src->attrib[i].map))) {
+			goto err;
+		}
+	}
+	return mtl;
+
+err:
+	goat3d_destroy_mtl(mtl);
+	return 0;
+}
+
+/* copies everything but the name, which is duplicated unless it's the default
+ * one. The clone is always allocated from the global allocator, never from an
+ * arena.
+ */
+static struct object *clone_obj(struct object *src, size_t size)
+{
+	struct object *obj;
+
+	if(!(obj = g3dimpl_malloc(size))) {
+		return 0;
+	}
+	memcpy(obj, src, size);
+	obj->arena = 0;
+	obj->next = 0;
+
+	if(src->name == src->defname) {
+		obj->name = obj->defname;
+	} else if(!(obj->name = g3dimpl_astrdup(0, src->name))) {
+		g3dimpl_free(obj);
+		return 0;
+	}
+	return obj;
+}
+
+/* mesh data arrays are shared with the source mesh, and copied by whichever
+ * of the two modifies them first (see dynarr_ref). The bone array is copied
+ * right away, since it has to point to the cloned nodes.
+ */
+static struct goat3d_mesh *clone_mesh(struct goat3d_mesh *src)
+{
+	struct goat3d_mesh *m;
+	int nbones;
+
+	if(!(m = (struct goat3d_mesh*)clone_obj((struct object*)src, sizeof *src))) {
+		return 0;
+	}
+	m->vertices = dynarr_ref(src->vertices);
+	m->normals = dynarr_ref(src->normals);
+	m->tangents = dynarr_ref(src->tangents);
+	m->texcoords = dynarr_ref(src->texcoords);
+	m->skin_weights = dynarr_ref(src->skin_weights);
+	m->skin_matrices = dynarr_ref(src->skin_matrices);
+	m->colors = dynarr_ref(src->colors);
+	m->faces = dynarr_ref(src->faces);
+	m->bone_invbind = dynarr_ref(src->bone_invbind);
+
+	nbones = dynarr_size(src->bones);
+	if(!(m->bones = dynarr_alloc(nbones, sizeof *m->bones))) {
+		goat3d_destroy_mesh(m);
+		return 0;
+	}
+	if(nbones) {
+		memcpy(m->bones, src->bones, nbones * sizeof *m->bones);
+	}
+	return m;
+}
+
+/* copies the node and all its animations. Hierarchy links, and the node
+ * object, are fixed up by goat3d_clone after every node is cloned.
+ */
+static struct goat3d_node *clone_node(struct goat3d_node *src)
+{
+	int i, j, num;
+	float px, py, pz;
+	struct goat3d_node *node;
+	struct anm_animation *sanim, *danim;
+
+	if(!(node = goat3d_create_node())) {
+		return 0;
+	}
+	if(src->anm.name && anm_set_node_name(&node->anm, src->anm.name) == -1) {
+		goto err;
+	}
+	node->type = src->type;
+	node->obj = src->obj;
+
+	anm_get_pivot(&src->anm, &px, &py, &pz);
+	anm_set_pivot(&node->anm, px, py, pz);
+
+	num = anm_get_animation_count(&src->anm);
+	for(i=0; i<num; i++) {
+		if(i >= anm_get_animation_count(&node->anm) && anm_add_animation(&node->anm) == -1) {
+			goto err;
+		}
+		sanim = anm_get_animation(&src->anm, i);
+		danim = anm_get_animation(&node->anm, i);
+		if(sanim->name && anm_set_animation_name(danim, sanim->name) == -1) {
+			goto err;
+		}
+		for(j=0; j<ANM_NUM_TRACKS; j++) {
+			anm_copy_track(danim->tracks + j, sanim->tracks + j);
+		}
+	}
+	anm_use_animations(&node->anm, anm_get_active_animation_index(&src->anm, 0),
+			anm_get_active_animation_index(&src->anm, 1), anm_get_active_animation_mix(&src->anm));
+	return node;
+
+err:
+	goat3d_destroy_node(node);
+	return 0;
+}
+
+static struct anm_node *reverse_list(struct anm_node *list)
+{
+	struct anm_node *next, *res = 0;
+
+	while(list) {
+		next = list->next;
+		list->next = res;
+		res = list;
+		list = next;
+	}
+	return res;
+}
+
+static int add_map(struct ptrmap **map, const void *src, void *dst)
+{
+	struct ptrmap *tmp, m;
+	int sz = dynarr_size(*map);
+
+	m.src = src;
+	m.dst = dst;
+	tmp = dynarr_push(*map, &m);
+	if(dynarr_size(tmp) <= sz) {
+		return -1;
+	}
+	*map = tmp;
+	return 0;
+}
+
+static void *lookup(struct ptrmap *map, const void *src)
+{
+	struct ptrmap key, *res;
+
+	key.src = src;
+	res = bsearch(&key, map, dynarr_size(map), sizeof *map, cmp_ptrmap);
+	return res ? res->dst : 0;
+}
+
+static int cmp_ptrmap(const void *a, const void *b)
+{
+	const char *pa = ((const struct ptrmap*)a)->src;
+	const char *pb = ((const struct ptrmap*)b)->src;
+	return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
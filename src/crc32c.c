@@ -0,0 +1,137 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <pthread.h>
+#include "crc32c.h"
+
+/* the hardware crc32 instruction is used when the compiler can target it, and
+ * the CPU running the code supports it (checked once at runtime, unless the
+ * whole library is built for SSE4.2 anyway). Otherwise fall back to a
+ * slicing-by-8 table implementation.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_HWCRC
+#endif
+
+#define POLY	0x82f63b78	/* reflected castagnoli polynomial */
+
+static void init_tables(void);
+static uint32_t crc_sw(uint32_t crc, const unsigned char *ptr, size_t len);
+#ifdef USE_HWCRC
+static uint32_t crc_hw(uint32_t crc, const unsigned char *ptr, size_t len);
+#endif
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc_func)(uint32_t, const unsigned char*, size_t);
+static uint32_t tab[8][256];
+
+
+uint32_t g3dimpl_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&init_once, init_tables);
+	return ~crc_func(~crc, buf, len);
+}
+
+static void init_tables(void)
+{
+	int i, j;
+	uint32_t crc;
+
+#ifdef USE_HWCRC
+#ifndef __SSE4_2__
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.2"))
+#endif
+	{
+		crc_func = crc_hw;
+		return;
+	}
+#endif
+
+	for(i=0; i<256; i++) {
+		crc = i;
+		for(j=0; j<8; j++) {
+			crc = (crc >> 1) ^ (crc & 1 ? POLY : 0);
+		}
+		tab[0][i] = crc;
+	}
+	for(i=0; i<256; i++) {
+		crc = tab[0][i];
+		for(j=1; j<8; j++) {
+			crc = (crc >> 8) ^ tab[0][crc & 0xff];
+			tab[j][i] = crc;
+		}
+	}
+	crc_func = crc_sw;
+}
+
+/* slicing-by-8: 8 table lookups for every 8 bytes, instead of a dependent
+ * lookup per byte. The data words are read as little endian.
+ */
+static uint32_t crc_sw(uint32_t crc, const unsigned char *ptr, size_t len)
+{
+	uint32_t lo, hi;
+
+	while(len >= 8) {
+		lo = crc ^ ((uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) |
+				((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+		hi = (uint32_t)ptr[4] | ((uint32_t)ptr[5] << 8) |
+			((uint32_t)ptr[6] << 16) | ((uint32_t)ptr[7] << 24);
+		crc = tab[7][lo & 0xff] ^ tab[6][(lo >> 8) & 0xff] ^
+			tab[5][(lo >> 16) & 0xff] ^ tab[4][lo >> 24] ^
+			tab[3][hi & 0xff] ^ tab[2][(hi >> 8) & 0xff] ^
+			tab[1][(hi >> 16) & 0xff] ^ tab[0][hi >> 24];
+		ptr += 8;
+		len -= 8;
+	}
+	while(len-- > 0) {
+		crc = (crc >> 8) ^ tab[0][(crc ^ *ptr++) & 0xff];
+	}
+	return crc;
+}
+
+#ifdef USE_HWCRC
+__attribute__((target("sse4.2")))
+static uint32_t crc_hw(uint32_t crc, const unsigned char *ptr, size_t len)
+{
+#ifdef __x86_64__
+	uint64_t crc64 = crc, word;
+
+	while(len >= 8) {
+		memcpy(&word, ptr, 8);
+		crc64 = __builtin_ia32_crc32di(crc64, word);
+		ptr += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)crc64;
+#else
+	uint32_t word;
+
+	while(len >= 4) {
+		memcpy(&word, ptr, 4);
+		crc = __builtin_ia32_crc32si(crc, word);
+		ptr += 4;
+		len -= 4;
+	}
+#endif
+	while(len-- > 0) {
+		crc = __builtin_ia32_crc32qi(crc, *ptr++);
+	}
+	return crc;
+}
+#endif	/* USE_HWCRC */
@@ -0,0 +1,38 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_CRC32C_H_
+#define GOAT3D_CRC32C_H_
+
+#include <stddef.h>
+#include "goat3d.h"
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#else
+typedef unsigned __int32 uint32_t;
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
+#endif
+
+/* CRC32C (castagnoli polynomial, the one implemented by the SSE4.2 crc32
+ * instruction). Start with crc = 0, and pass the result of each call to the
+ * next one to checksum data in pieces.
+ */
+uint32_t g3dimpl_crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif	/* GOAT3D_CRC32C_H_ */
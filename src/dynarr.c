@@ -5,66 +5,210 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "dynarr.h"
+#include "arena.h"
+#include "g3datomic.h"
 
 /* The array descriptor keeps auxilliary information needed to manipulate
  * the dynamic array. It's allocated adjacent to the array buffer.
  */
 struct arrdesc {
-	int nelem, szelem;
-	int max_elem;
-	int bufsz;	/* not including the descriptor */
+	size_t nelem, szelem;
+	size_t max_elem;
+	size_t bufsz;	/* allocated buffer size, not including the descriptor */
+	struct arena *arena;	/* non-null if allocated from an arena */
+	int refcnt;	/* number of owners, see dynarr_ref */
 };
 
 #define DESC(x)		((struct arrdesc*)((char*)(x) - sizeof(struct arrdesc)))
 
-void *dynarr_alloc(int elem, int szelem)
+static void *unshare(void *da);
+static int release(struct arrdesc *desc);
+
+/* guards the reference count of shared arrays. Arrays with a single owner
+ * never touch it. Changes are stored atomically, so that the owner checks
+ * outside the lock can read the count with g3dimpl_relaxed_load.
+ */
+static pthread_mutex_t ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *dynarr_alloc(size_t elem, size_t szelem)
+{
+	return dynarr_alloc_arena(elem, szelem, 0);
+}
+
+void *dynarr_alloc_arena(size_t elem, size_t szelem, struct arena *arena)
 {
 	struct arrdesc *desc;
 
-	if(!(desc = malloc(elem * szelem + sizeof *desc))) {
+	if(!(desc = g3dimpl_aalloc(arena, elem * szelem + sizeof *desc))) {
 		return 0;
 	}
 	desc->nelem = desc->max_elem = elem;
 	desc->szelem = szelem;
 	desc->bufsz = elem * szelem;
+	desc->arena = arena;
+	desc->refcnt = 1;
 	return (char*)desc + sizeof *desc;
 }
 
 void dynarr_free(void *da)
+{
+	if(da && release(DESC(da))) {
+		g3dimpl_afree(DESC(da)->arena, DESC(da));
+	}
+}
+
+void *dynarr_ref(void *da)
 {
 	if(da) {
-		free(DESC(da));
+		struct arrdesc *desc = DESC(da);
+		pthread_mutex_lock(&ref_lock);
+		g3dimpl_relaxed_store(&desc->refcnt, desc->refcnt + 1);
+		pthread_mutex_unlock(&ref_lock);
 	}
+	return da;
 }
 
-void *dynarr_resize(void *da, int elem)
+int dynarr_shared(void *da)
 {
-	int newsz;
-	void *tmp;
-	struct arrdesc *desc;
+	return g3dimpl_relaxed_load(&DESC(da)->refcnt) > 1;
+}
 
-	if(!da) return 0;
-	desc = DESC(da);
+void *dynarr_unshare(void *da)
+{
+	return da ? unshare(da) : 0;
+}
+
+/* drops a reference, returns non-zero if it was the last one */
+static int release(struct arrdesc *desc)
+{
+	int last;
+
+	if(g3dimpl_relaxed_load(&desc->refcnt) <= 1) return 1;
+
+	pthread_mutex_lock(&ref_lock);
+	last = desc->refcnt == 1;
+	g3dimpl_relaxed_store(&desc->refcnt, desc->refcnt - 1);
+	pthread_mutex_unlock(&ref_lock);
+	return last;
+}
+
+/* returns an array with a single owner and the same contents: da itself if
+ * it's not shared, otherwise a private copy, dropping our reference to da.
+ * The copy always comes from the global allocator, since the arena of a
+ * shared array belongs to whoever else is using it.
+ */
+static void *unshare(void *da)
+{
+	struct arrdesc *desc = DESC(da), *copy;
+
+	if(g3dimpl_relaxed_load(&desc->refcnt) <= 1) return da;
+
+	if(!(copy = g3dimpl_malloc(desc->bufsz + sizeof *desc))) {
+		return 0;
+	}
+	copy->nelem = desc->nelem;
+	copy->szelem = desc->szelem;
+	copy->max_elem = desc->max_elem;
+	copy->bufsz = desc->bufsz;
+	copy->arena = 0;
+	copy->refcnt = 1;
+	memcpy(copy + 1, da, desc->nelem * desc->szelem);
+
+	if(release(desc)) {
+		g3dimpl_afree(desc->arena, desc);
+	}
+	return copy + 1;
+}
+
+/* reallocates the array buffer to hold exactly cap elements, keeping nelem */
+static void *set_capacity(void *da, size_t cap)
+{
+	size_t newsz;
+	void *tmp;
+	struct arrdesc *desc = DESC(da);
 
-	newsz = desc->szelem * elem;
+	newsz = desc->szelem * cap;
 
-	if(!(tmp = realloc(desc, newsz + sizeof *desc))) {
+	if(!(tmp = g3dimpl_arealloc(desc->arena, desc, desc->bufsz + sizeof *desc, newsz + sizeof *desc))) {
 		return 0;
 	}
 	desc = tmp;
 
-	desc->nelem = desc->max_elem = elem;
+	desc->max_elem = cap;
 	desc->bufsz = newsz;
+	if(desc->nelem > cap) {
+		desc->nelem = cap;
+	}
 	return (char*)desc + sizeof *desc;
 }
 
+void *dynarr_resize(void *da, size_t elem)
+{
+	size_t cap;
+
+	if(!da || !(da = unshare(da))) return 0;
+
+	if(elem > DESC(da)->max_elem) {
+		/* grow geometrically, unless asked for more than double */
+		cap = DESC(da)->max_elem * 2;
+		if(cap < elem) cap = elem;
+
+		if(!(da = set_capacity(da, cap))) {
+			return 0;
+		}
+	}
+	DESC(da)->nelem = elem;
+	return da;
+}
+
+void *dynarr_reserve(void *da, size_t elem)
+{
+	if(!da || !(da = unshare(da))) return 0;
+
+	if(elem > DESC(da)->max_elem) {
+		return set_capacity(da, elem);
+	}
+	return da;
+}
+
+void *dynarr_shrink_to_fit(void *da)
+{
+	if(!da || !(da = unshare(da))) return 0;
+
+	if(DESC(da)->max_elem > DESC(da)->nelem) {
+		return set_capacity(da, DESC(da)->nelem);
+	}
+	return da;
+}
+
+size_t dynarr_capacity(void *da)
+{
+	return DESC(da)->max_elem;
+}
+
+void dynarr_mem_usage(void *da, size_t *used, size_t *reserved)
+{
+	struct arrdesc *desc;
+	int refcnt;
+
+	if(!da) return;
+	desc = DESC(da);
+	refcnt = g3dimpl_relaxed_load(&desc->refcnt);
+	/* each owner of a shared array gets its share, so that stats of scenes
+	 * sharing data add up to what's actually allocated
+	 */
+	*used += desc->nelem * desc->szelem / refcnt;
+	*reserved += (desc->bufsz + sizeof(struct arrdesc)) / refcnt;
+}
+
 int dynarr_empty(void *da)
 {
 	return DESC(da)->nelem ? 0 : 1;
 }
 
-int dynarr_size(void *da)
+size_t dynarr_size(void *da)
 {
 	return DESC(da)->nelem;
 }
@@ -79,23 +223,28 @@ void *dynarr_clear(void *da)
 void *dynarr_push(void *da, void *item)
 {
 	struct arrdesc *desc;
-	int nelem;
+	size_t nelem;
+	void *tmpda;
 
+	if(!(tmpda = unshare(da))) {
+		fprintf(stderr, "failed to copy shared array\n");
+		return da;
+	}
+	da = tmpda;
 	desc = DESC(da);
 	nelem = desc->nelem;
 
 	if(nelem >= desc->max_elem) {
 		/* need to resize */
 		struct arrdesc *tmp;
-		int newsz = desc->max_elem ? desc->max_elem * 2 : 1;
+		size_t newsz = desc->max_elem ? desc->max_elem * 2 : 1;
 
-		if(!(tmp = dynarr_resize(da, newsz))) {
+		if(!(tmp = set_capacity(da, newsz))) {
 			fprintf(stderr, "failed to resize\n");
 			return da;
 		}
 		da = tmp;
 		desc = DESC(da);
-		desc->nelem = nelem;
 	}
 
 	if(item) {
@@ -107,25 +256,30 @@ void *dynarr_push(void *da, void *item)
 void *dynarr_pop(void *da)
 {
 	struct arrdesc *desc;
-	int nelem;
+	size_t nelem;
+	void *tmpda;
+
+	if(!DESC(da)->nelem) return da;
 
+	if(!(tmpda = unshare(da))) {
+		fprintf(stderr, "failed to copy shared array\n");
+		return da;
+	}
+	da = tmpda;
 	desc = DESC(da);
 	nelem = desc->nelem;
 
-	if(!nelem) return da;
-
 	if(nelem <= desc->max_elem / 3) {
 		/* reclaim space */
 		struct arrdesc *tmp;
-		int newsz = desc->max_elem / 2;
+		size_t newsz = desc->max_elem / 2;
 
-		if(!(tmp = dynarr_resize(da, newsz))) {
+		if(!(tmp = set_capacity(da, newsz))) {
 			fprintf(stderr, "failed to resize\n");
 			return da;
 		}
 		da = tmp;
 		desc = DESC(da);
-		desc->nelem = nelem;
 	}
 	desc->nelem--;
 
@@ -135,6 +289,6 @@ void *dynarr_pop(void *da)
 void *dynarr_finalize(void *da)
 {
 	struct arrdesc *desc = DESC(da);
-	memmove(desc, da, desc->bufsz);
+	memmove(desc, da, desc->nelem * desc->szelem);
 	return desc;
 }
@@ -5,9 +5,19 @@
 #ifndef DYNARR_H_
 #define DYNARR_H_
 
+#include <stddef.h>
+
 #define dynarr_alloc	g3dimpl_dynarr_alloc
+#define dynarr_alloc_arena	g3dimpl_dynarr_alloc_arena
 #define dynarr_free		g3dimpl_dynarr_free
+#define dynarr_ref		g3dimpl_dynarr_ref
+#define dynarr_shared	g3dimpl_dynarr_shared
+#define dynarr_unshare	g3dimpl_dynarr_unshare
 #define dynarr_resize	g3dimpl_dynarr_resize
+#define dynarr_reserve	g3dimpl_dynarr_reserve
+#define dynarr_shrink_to_fit	g3dimpl_dynarr_shrink_to_fit
+#define dynarr_capacity	g3dimpl_dynarr_capacity
+#define dynarr_mem_usage	g3dimpl_dynarr_mem_usage
 #define dynarr_empty	g3dimpl_dynarr_empty
 #define dynarr_size		g3dimpl_dynarr_size
 #define dynarr_clear	g3dimpl_dynarr_clear
@@ -32,17 +42,56 @@
  *  dynarr_free(arr);
  */
 
-void *dynarr_alloc(int elem, int szelem);
+struct arena;
+
+void *dynarr_alloc(size_t elem, size_t szelem);
+/* dynarr_alloc_arena allocates the array, and all its future resizes, from a
+ * region allocator. dynarr_free is a no-op for such arrays, their memory is
+ * released when the arena is cleared.
+ */
+void *dynarr_alloc_arena(size_t elem, size_t szelem, struct arena *arena);
 void dynarr_free(void *da);
-void *dynarr_resize(void *da, int elem);
+/* dynarr_ref adds an owner to the array and returns it. Shared arrays are
+ * copy-on-write: every function which modifies the array (resize, push, pop,
+ * etc) first makes a private copy for the caller if there are other owners,
+ * and dynarr_free only releases the memory when the last owner frees it.
+ * Elements of a shared array must not be modified in place.
+ */
+void *dynarr_ref(void *da);
+/* dynarr_shared returns non-zero if the array has more than one owner */
+int dynarr_shared(void *da);
+/* dynarr_unshare returns a private copy of the array if it's shared, for
+ * modifying elements in place, or the array itself otherwise. Returns null
+ * on failure, in which case the array is left as it was.
+ */
+void *dynarr_unshare(void *da);
+/* dynarr_resize changes the number of elements in the array. The buffer is
+ * only reallocated when growing past the current capacity, in which case the
+ * capacity is at least doubled, so that following pushes don't reallocate.
+ * Complexity: amortized O(1) */
+void *dynarr_resize(void *da, size_t elem);
+/* dynarr_reserve makes room for at least elem elements, without changing the
+ * size of the array. */
+void *dynarr_reserve(void *da, size_t elem);
+/* dynarr_shrink_to_fit releases any unused capacity */
+void *dynarr_shrink_to_fit(void *da);
+/* dynarr_capacity returns the number of elements the array can hold without
+ * reallocating */
+size_t dynarr_capacity(void *da);
+/* dynarr_mem_usage adds the bytes used by the elements of the array to *used,
+ * and the bytes allocated for the array, including unused capacity and the
+ * descriptor, to *reserved. Both are divided by the number of owners of shared
+ * arrays (see dynarr_ref) */
+void dynarr_mem_usage(void *da, size_t *used, size_t *reserved);
 
 /* dynarr_empty returns non-zero if the array is empty
  * Complexity: O(1) */
 int dynarr_empty(void *da);
 /* dynarr_size returns the number of elements in the array
  * Complexity: O(1) */
-int dynarr_size(void *da);
+size_t dynarr_size(void *da);
 
+/* dynarr_clear empties the array, keeping its capacity */
 void *dynarr_clear(void *da);
 
 /* stack semantics */
@@ -50,7 +99,9 @@ void *dynarr_push(void *da, void *item);
 void *dynarr_pop(void *da);
 
 /* Finalize the array. No more resizing is possible after this call.
- * Use free() instead of dynarr_free() to deallocate a finalized array.
+ * Use g3dimpl_free (the free function passed to goat3d_set_allocator)
+ * instead of dynarr_free() to deallocate a finalized array.
+ * Arrays allocated from an arena can't be finalized.
  * Returns pointer to the finalized array.
  * dynarr_finalize can't fail.
  * Complexity: O(n)
@@ -60,6 +111,7 @@ void *dynarr_finalize(void *da);
 /* helper macros */
 #define DYNARR_RESIZE(da, n) \
 	do { (da) = dynarr_resize((da), (n)); } while(0)
+
 #define DYNARR_CLEAR(da) \
 	do { (da) = dynarr_clear(da); } while(0)
 #define DYNARR_PUSH(da, item) \
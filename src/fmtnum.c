@@ -0,0 +1,356 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <math.h>
+#include "fmtnum.h"
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#else
+typedef unsigned __int32 uint32_t;
+typedef unsigned __int64 uint64_t;
+#endif
+
+/* decimal digits are found with double precision arithmetic, which has 29
+ * more bits than a float. Candidates are only accepted if they fall inside the
+ * rounding interval of the float by a margin much larger than the double
+ * rounding error, so the result always reads back as the same float. The 9
+ * digit candidate always passes, since 9 digits are enough for any float.
+ */
+#define MARGIN	1e-12
+
+static const double pow10tab[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const float pow10ftab[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+static double pow10i(int e)
+{
+	double res = 1.0;
+
+	if(e < 0) return 1.0 / pow10i(-e);
+
+	while(e > 22) {
+		res *= 1e22;
+		e -= 22;
+	}
+	return res * pow10tab[e];
+}
+
+static float float_bits(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof f);
+	return f;
+}
+
+static int put_digits(char *buf, uint32_t dig, int ndig)
+{
+	int i;
+	for(i=ndig-1; i>=0; i--) {
+		buf[i] = '0' + dig % 10;
+		dig /= 10;
+	}
+	return ndig;
+}
+
+int g3dimpl_fmt_float(char *buf, float x)
+{
+	uint32_t u, dig = 0, p10;
+	int p, k, s, ndig, i;
+	double v, lo, hi, scaled, cand, margin;
+	char digits[10], *ptr = buf;
+
+	memcpy(&u, &x, sizeof u);
+	if(u & 0x80000000) {
+		*ptr++ = '-';
+		u &= 0x7fffffff;
+	}
+
+	if(u >= 0x7f800000) {
+		if(u > 0x7f800000) ptr = buf;	/* no sign for nan */
+		strcpy(ptr, u == 0x7f800000 ? "inf" : "nan");
+		return ptr - buf + 3;
+	}
+	if(u == 0) {
+		*ptr++ = '0';
+		*ptr = 0;
+		return ptr - buf;
+	}
+
+	v = float_bits(u);
+
+	/* rounding interval: half way to the neighbouring floats (exact in double) */
+	lo = (v + float_bits(u - 1)) * 0.5;
+	hi = u < 0x7f7fffff ? (v + float_bits(u + 1)) * 0.5 : v + (v - lo);
+	margin = v * MARGIN;
+
+	/* decimal exponent of the first significant digit */
+	k = (int)floor(log10(v));
+	if(pow10i(k) > v) {
+		k--;
+	} else if(pow10i(k + 1) <= v) {
+		k++;
+	}
+
+	p10 = 1;
+	for(p=1; p<=9; p++) {
+		p10 *= 10;
+		s = p - 1 - k;
+		scaled = s >= 0 ? v * pow10i(s) : v / pow10i(-s);
+		dig = (uint32_t)(scaled + 0.5);
+		cand = s >= 0 ? dig / pow10i(s) : dig * pow10i(-s);
+
+		if(cand > lo + margin && cand < hi - margin) {
+			break;
+		}
+		/* exactly half way between two floats rounds to the even one. Ties
+		 * can only be trusted when the candidate is an exact integer.
+		 */
+		if(!(u & 1) && s <= 0 && s >= -22 && cand < 9007199254740992.0 &&
+				(cand == lo || cand == hi)) {
+			break;
+		}
+	}
+	if(p > 9) p = 9;	/* can't happen */
+
+	if(dig >= p10) {
+		/* rounded up to the next power of 10 */
+		dig /= 10;
+		k++;
+	}
+	ndig = put_digits(digits, dig, p);
+	while(ndig > 1 && digits[ndig - 1] == '0') {
+		ndig--;
+	}
+
+	if(k >= -4 && k < 9) {
+		if(k < 0) {
+			*ptr++ = '0';
+			*ptr++ = '.';
+			for(i=0; i<-k-1; i++) {
+				*ptr++ = '0';
+			}
+			memcpy(ptr, digits, ndig);
+			ptr += ndig;
+		} else {
+			for(i=0; i<=k; i++) {
+				*ptr++ = i < ndig ? digits[i] : '0';
+			}
+			if(ndig > k + 1) {
+				*ptr++ = '.';
+				memcpy(ptr, digits + k + 1, ndig - k - 1);
+				ptr += ndig - k - 1;
+			}
+		}
+	} else {
+		*ptr++ = digits[0];
+		if(ndig > 1) {
+			*ptr++ = '.';
+			memcpy(ptr, digits + 1, ndig - 1);
+			ptr += ndig - 1;
+		}
+		*ptr++ = 'e';
+		if(k < 0) {
+			*ptr++ = '-';
+			k = -k;
+		}
+		ptr += put_digits(ptr, k, k >= 10 ? 2 : 1);
+	}
+	*ptr = 0;
+	return ptr - buf;
+}
+
+int g3dimpl_fmt_int(char *buf, int x)
+{
+	char *ptr = buf;
+	unsigned int ux = x;
+	int ndig;
+	unsigned int tmp;
+
+	if(x < 0) {
+		*ptr++ = '-';
+		ux = 0u - ux;
+	}
+
+	ndig = 1;
+	tmp = ux;
+	while(tmp >= 10) {
+		tmp /= 10;
+		ndig++;
+	}
+	ptr += put_digits(ptr, ux, ndig);
+	*ptr = 0;
+	return ptr - buf;
+}
+
+int g3dimpl_fmt_floatv(char *buf, const float *v, int count)
+{
+	int i;
+	char *ptr = buf;
+
+	*ptr = 0;
+	for(i=0; i<count; i++) {
+		if(i) {
+			*ptr++ = ',';
+			*ptr++ = ' ';
+		}
+		ptr += g3dimpl_fmt_float(ptr, v[i]);
+	}
+	return ptr - buf;
+}
+
+#define IS_DIGIT(c)	((unsigned int)((c) - '0') < 10)
+
+/* mant * 10^exp10 rounded to float. With mant < 2^53 and |exp10| <= 22 both
+ * operands are exact, so the double result is correctly rounded. It's then
+ * rounded again to float, which goes wrong only if the double is exactly half
+ * way between two floats; in that case the exact residual (fma) tells which
+ * way the real value lies.
+ */
+static float to_float(uint64_t mant, int exp10)
+{
+	double d, p, q, resid;
+	uint64_t bits;
+
+	if(!mant) return 0.0f;
+
+	/* most numbers in scene files have at most 7 digits, which can be done
+	 * exactly in single precision
+	 */
+	if(mant < ((uint64_t)1 << 24) && exp10 >= -10 && exp10 <= 10) {
+		return exp10 < 0 ? (float)mant / pow10ftab[-exp10] : (float)mant * pow10ftab[exp10];
+	}
+
+	d = (double)mant;
+	if(mant >= ((uint64_t)1 << 53) || exp10 < -22 || exp10 > 22) {
+		if(exp10 < -330) return 0.0f;
+		if(exp10 > 310) return (float)HUGE_VAL;
+		return (float)(exp10 < 0 ? d / pow10i(-exp10) : d * pow10i(exp10));
+	}
+
+	p = pow10tab[exp10 < 0 ? -exp10 : exp10];
+	q = exp10 < 0 ? d / p : d * p;
+
+	memcpy(&bits, &q, sizeof bits);
+	if((bits & 0x1fffffff) == 0x10000000) {
+		/* q - real value, with the sign of the error */
+		resid = exp10 < 0 ? fma(q, p, -d) : -fma(d, p, -q);
+		if(resid > 0) {
+			q = nextafter(q, 0.0);
+		} else if(resid < 0) {
+			q = nextafter(q, HUGE_VAL);
+		}
+	}
+	return (float)q;
+}
+
+const char *g3dimpl_parse_float(const char *ptr, const char *end, float *res)
+{
+	uint64_t mant = 0;
+	int neg = 0, eneg = 0, ndig = 0, exp10 = 0, e = 0, any = 0;
+	float val;
+
+	if(ptr < end && (*ptr == '-' || *ptr == '+')) {
+		neg = *ptr++ == '-';
+	}
+
+	while(ptr < end && IS_DIGIT(*ptr)) {
+		if(ndig < 19) {
+			mant = mant * 10 + (*ptr - '0');
+			if(mant) ndig++;
+		} else {
+			exp10++;	/* excess digits are truncated */
+		}
+		ptr++;
+		any = 1;
+	}
+	if(ptr < end && *ptr == '.') {
+		ptr++;
+		while(ptr < end && IS_DIGIT(*ptr)) {
+			if(ndig < 19) {
+				mant = mant * 10 + (*ptr - '0');
+				if(mant) ndig++;
+				exp10--;
+			}
+			ptr++;
+			any = 1;
+		}
+	}
+
+	if(!any) {
+		if(end - ptr >= 3 && (memcmp(ptr, "inf", 3) == 0 || memcmp(ptr, "nan", 3) == 0)) {
+			val = ptr[0] == 'i' ? (float)HUGE_VAL : (float)(HUGE_VAL - HUGE_VAL);
+			*res = neg ? -val : val;
+			return ptr + 3;
+		}
+		return 0;
+	}
+
+	if(ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+		const char *eptr = ptr + 1;
+		if(eptr < end && (*eptr == '-' || *eptr == '+')) {
+			eneg = *eptr++ == '-';
+		}
+		if(eptr < end && IS_DIGIT(*eptr)) {
+			while(eptr < end && IS_DIGIT(*eptr)) {
+				if(e < 10000) e = e * 10 + (*eptr - '0');
+				eptr++;
+			}
+			exp10 += eneg ? -e : e;
+			ptr = eptr;
+		}
+	}
+
+	val = to_float(mant, exp10);
+	*res = neg ? -val : val;
+	return ptr;
+}
+
+const char *g3dimpl_parse_int(const char *ptr, const char *end, int *res)
+{
+	const char *start = ptr;
+	unsigned int val = 0;
+	int neg = 0;
+	float fval;
+
+	if(ptr < end && (*ptr == '-' || *ptr == '+')) {
+		neg = *ptr++ == '-';
+	}
+	if(ptr >= end || !IS_DIGIT(*ptr)) {
+		return 0;
+	}
+	while(ptr < end && IS_DIGIT(*ptr)) {
+		val = val * 10 + (*ptr++ - '0');
+	}
+
+	if(ptr < end && (*ptr == '.' || *ptr == 'e' || *ptr == 'E')) {
+		if(!(ptr = g3dimpl_parse_float(start, end, &fval))) {
+			return 0;
+		}
+		*res = (int)fval;
+		return ptr;
+	}
+
+	*res = neg ? -(int)val : (int)val;
+	return ptr;
+}
@@ -0,0 +1,48 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_FMTNUM_H_
+#define GOAT3D_FMTNUM_H_
+
+/* locale-independent number formatting for text output. Floats are formatted
+ * with the fewest significant digits which read back as exactly the same
+ * float (at most 9), except for rare values with a shorter candidate exactly
+ * on a rounding boundary, which get one more digit.
+ */
+
+#define FMT_FLOAT_MAX	16	/* longest formatted float, including the terminator */
+#define FMT_INT_MAX		12
+
+/* all return the length of the string written to buf (excluding the terminator) */
+int g3dimpl_fmt_float(char *buf, float x);
+int g3dimpl_fmt_int(char *buf, int x);
+/* formats count floats separated by ", ", buf must have room for
+ * count * (FMT_FLOAT_MAX + 2) bytes
+ */
+int g3dimpl_fmt_floatv(char *buf, const float *v, int count);
+
+/* parse a number starting at ptr, without going past end. Return a pointer
+ * right after the number, or null if there isn't one. Floats are correctly
+ * rounded when they have at most 19 significant digits and a decimal exponent
+ * within +/-22 (anything written by g3dimpl_fmt_float), and within an ulp
+ * otherwise. g3dimpl_parse_int also accepts numbers with a fractional part or
+ * an exponent, and truncates them.
+ */
+const char *g3dimpl_parse_float(const char *ptr, const char *end, float *res);
+const char *g3dimpl_parse_int(const char *ptr, const char *end, int *res);
+
+#endif	/* GOAT3D_FMTNUM_H_ */
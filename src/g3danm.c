@@ -0,0 +1,674 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include "g3danm.h"
+#include "tpool.h"
+#include "g3datomic.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+const int g3dimpl_track_base[] = {ANM_TRACK_POS_X, ANM_TRACK_ROT_X, ANM_TRACK_SCL_X};
+const int g3dimpl_track_nelem[] = {3, 4, 3};
+
+const char *g3dimpl_track_attr_names[] = {"position", "rotation", "scaling", 0};
+const char *g3dimpl_interp_names[] = {"step", "linear", "cubic", 0};
+const char *g3dimpl_extrap_names[] = {"extend", "clamp", "repeat", "pingpong", 0};
+
+static int key_interval(const struct anm_track *trk, anm_time_t tm, int *cursor);
+static struct anm_animation *single_anim(struct goat3d_node *node);
+static void bake_node(float *dest, int cstride, struct anm_node *node, int anim_idx,
+		anm_time_t tm, int *cursor);
+static int cmp_nodeptr(const void *a, const void *b);
+static void eval_job(int idx, void *cls);
+
+struct nodeptr {
+	struct anm_node *node;
+	int idx;
+};
+
+struct eval_context {
+	struct goat3d_node **nodes;
+	int num_nodes;
+	int *parent;	/* parent index of each node, -1 for roots */
+	int *order;		/* node indices, parents before their children */
+	struct goat3d_anim_job *jobs;
+};
+
+int g3dimpl_find_name(const char **names, const char *str)
+{
+	int i;
+	for(i=0; names[i]; i++) {
+		if(strcmp(names[i], str) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+float g3dimpl_track_value(struct anm_track *trk, anm_time_t tm, int *cursor)
+{
+	int idx, last;
+	float t;
+	struct anm_keyframe *k0, *k1;
+
+	if(!trk->count) {
+		return trk->def_val;
+	}
+	last = trk->count - 1;
+	if(tm <= trk->keys[0].time) {
+		return trk->keys[0].val;
+	}
+	if(tm >= trk->keys[last].time) {
+		return trk->keys[last].val;
+	}
+	if(trk->interp == ANM_INTERP_CUBIC) {
+		/* needs neighbouring keys and tangents, leave it to libanim */
+		return anm_get_value(trk, tm);
+	}
+
+	idx = key_interval(trk, tm, cursor);
+	k0 = trk->keys + idx;
+	if(trk->interp == ANM_INTERP_STEP) {
+		return k0->val;
+	}
+	k1 = k0 + 1;
+	t = (float)(tm - k0->time) / (float)(k1->time - k0->time);
+	return k0->val + (k1->val - k0->val) * t;
+}
+
+void g3dimpl_track_rotation(struct anm_track *trk, anm_time_t tm, int *cursor, cgm_quat *res)
+{
+	int i, idx, last, nkeys = trk->count;
+	float t;
+	cgm_quat q0, q1;
+
+	for(i=1; i<4; i++) {
+		if(trk[i].count != nkeys) {
+			/* keys are not aligned across the 4 tracks, sample each separately */
+			res->x = g3dimpl_track_value(trk, tm, cursor);
+			res->y = g3dimpl_track_value(trk + 1, tm, cursor ? cursor + 1 : 0);
+			res->z = g3dimpl_track_value(trk + 2, tm, cursor ? cursor + 2 : 0);
+			res->w = g3dimpl_track_value(trk + 3, tm, cursor ? cursor + 3 : 0);
+			cgm_qnormalize(res);
+			return;
+		}
+	}
+
+	if(!nkeys) {
+		cgm_qcons(res, trk[0].def_val, trk[1].def_val, trk[2].def_val, trk[3].def_val);
+		return;
+	}
+	last = nkeys - 1;
+	if(tm <= trk->keys[0].time || tm >= trk->keys[last].time) {
+		idx = tm <= trk->keys[0].time ? 0 : last;
+		cgm_qcons(res, trk[0].keys[idx].val, trk[1].keys[idx].val, trk[2].keys[idx].val,
+				trk[3].keys[idx].val);
+		return;
+	}
+
+	idx = key_interval(trk, tm, cursor);
+	cgm_qcons(&q0, trk[0].keys[idx].val, trk[1].keys[idx].val, trk[2].keys[idx].val,
+			trk[3].keys[idx].val);
+	if(trk->interp == ANM_INTERP_STEP) {
+		*res = q0;
+		return;
+	}
+	idx++;
+	cgm_qcons(&q1, trk[0].keys[idx].val, trk[1].keys[idx].val, trk[2].keys[idx].val,
+			trk[3].keys[idx].val);
+
+	t = (float)(tm - trk->keys[idx - 1].time) / (float)(trk->keys[idx].time - trk->keys[idx - 1].time);
+	cgm_qslerp(res, &q0, &q1, t);
+}
+
+int g3dimpl_track_inrange(const struct anm_track *trk, anm_time_t tm)
+{
+	if(trk->count < 2) {
+		return 1;	/* constant, extrapolation makes no difference */
+	}
+	return tm >= trk->keys[0].time && tm < trk->keys[trk->count - 1].time;
+}
+
+void g3dimpl_node_position(struct goat3d_node *node, float *res, anm_time_t tm)
+{
+	int i;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+
+	if(!(anim = single_anim(node))) {
+		anm_get_node_position(&node->anm, res, tm);
+		return;
+	}
+	trk = anim->tracks + ANM_TRACK_POS_X;
+
+	for(i=0; i<3; i++) {
+		if(!g3dimpl_track_inrange(trk + i, tm)) {
+			anm_get_node_position(&node->anm, res, tm);
+			return;
+		}
+	}
+	for(i=0; i<3; i++) {
+		res[i] = g3dimpl_track_value(trk + i, tm, node->key_cursor + ANM_TRACK_POS_X + i);
+	}
+}
+
+void g3dimpl_node_rotation(struct goat3d_node *node, float *res, anm_time_t tm)
+{
+	int i;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+
+	if(!(anim = single_anim(node))) {
+		anm_get_node_rotation(&node->anm, res, tm);
+		return;
+	}
+	trk = anim->tracks + ANM_TRACK_ROT_X;
+
+	for(i=0; i<4; i++) {
+		if(!g3dimpl_track_inrange(trk + i, tm) || trk[i].interp == ANM_INTERP_CUBIC) {
+			anm_get_node_rotation(&node->anm, res, tm);
+			return;
+		}
+	}
+	g3dimpl_track_rotation(trk, tm, node->key_cursor + ANM_TRACK_ROT_X, (cgm_quat*)res);
+}
+
+void g3dimpl_node_scaling(struct goat3d_node *node, float *res, anm_time_t tm)
+{
+	int i;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+
+	if(!(anim = single_anim(node))) {
+		anm_get_node_scaling(&node->anm, res, tm);
+		return;
+	}
+	trk = anim->tracks + ANM_TRACK_SCL_X;
+
+	for(i=0; i<3; i++) {
+		if(!g3dimpl_track_inrange(trk + i, tm)) {
+			anm_get_node_scaling(&node->anm, res, tm);
+			return;
+		}
+	}
+	for(i=0; i<3; i++) {
+		res[i] = g3dimpl_track_value(trk + i, tm, node->key_cursor + ANM_TRACK_SCL_X + i);
+	}
+}
+
+anm_time_t g3dimpl_remap_time(const struct anm_track *trk, anm_time_t tm)
+{
+	anm_time_t tstart, interv, x;
+
+	if(trk->count < 2) {
+		return tm;
+	}
+	tstart = trk->keys[0].time;
+	if((interv = trk->keys[trk->count - 1].time - tstart) <= 0) {
+		return tm;
+	}
+
+	switch(trk->extrap) {
+	case ANM_EXTRAP_REPEAT:
+		if((x = (tm - tstart) % interv) < 0) x += interv;
+		return tstart + x;
+
+	case ANM_EXTRAP_PINGPONG:
+		if((x = (tm - tstart) % (interv * 2)) < 0) x += interv * 2;
+		return tstart + (x < interv ? x : interv * 2 - x);
+
+	default:
+		break;
+	}
+	return tm;
+}
+
+int g3dimpl_bake_anim(struct goat3d_baked_anim *ba, struct goat3d_node **nodes,
+		int num_nodes, int anim_idx, float rate_hz)
+{
+	int i, j, f;
+	size_t stride;
+	double nframes;
+	long tstart = LONG_MAX, tend = LONG_MIN;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+	int (*cursors)[ANM_NUM_TRACKS];
+	float *frm, *prev, *qprev, *qcur;
+
+	memset(ba, 0, sizeof *ba);
+	if(rate_hz <= 0.0f) {
+		return -1;
+	}
+
+	for(i=0; i<num_nodes; i++) {
+		if(!(anim = anm_get_animation(&nodes[i]->anm, anim_idx))) {
+			continue;
+		}
+		for(j=0; j<ANM_NUM_TRACKS; j++) {
+			trk = anim->tracks + j;
+			if(trk->count > 0) {
+				if(trk->keys[0].time < tstart) tstart = trk->keys[0].time;
+				if(trk->keys[trk->count - 1].time > tend) tend = trk->keys[trk->count - 1].time;
+			}
+		}
+	}
+	if(tstart > tend) {
+		tstart = tend = 0;	/* no keyframes, bake a single frame of the static pose */
+	}
+
+	/* a long time range at a high rate can overflow the frame count, or the
+	 * size of the frames array
+	 */
+	nframes = ceil((double)(tend - tstart) * rate_hz / 1000.0) + 1.0;
+	stride = (size_t)ANM_NUM_TRACKS * num_nodes;
+	if(nframes > INT_MAX || num_nodes > INT_MAX / ANM_NUM_TRACKS ||
+			(stride && (size_t)nframes > (size_t)-1 / sizeof *ba->frames / stride)) {
+		return -1;
+	}
+
+	ba->num_nodes = num_nodes;
+	ba->tstart = tstart;
+	ba->tend = tend;
+	ba->rate = rate_hz;
+	ba->num_frames = (int)nframes;
+
+	if(!(ba->frames = g3dimpl_malloc(ba->num_frames * stride * sizeof *ba->frames))) {
+		return -1;
+	}
+	if(!(ba->times = g3dimpl_malloc(ba->num_frames * sizeof *ba->times))) {
+		g3dimpl_free(ba->frames);
+		ba->frames = 0;
+		return -1;
+	}
+	if(!(cursors = g3dimpl_calloc(num_nodes ? num_nodes : 1, sizeof *cursors))) {
+		g3dimpl_free(ba->frames);
+		g3dimpl_free(ba->times);
+		ba->frames = 0;
+		ba->times = 0;
+		return -1;
+	}
+
+	for(f=0; f<ba->num_frames; f++) {
+		anm_time_t tm = tstart + (anm_time_t)((double)f * 1000.0 / rate_hz + 0.5);
+		if(tm > tend) tm = tend;
+		ba->times[f] = tm;
+
+		frm = ba->frames + f * stride;
+		for(i=0; i<num_nodes; i++) {
+			bake_node(frm + i, num_nodes, &nodes[i]->anm, anim_idx, tm, cursors[i]);
+		}
+
+		if(f > 0) {
+			/* keep consecutive rotations in the same hemisphere, so that nlerp
+			 * between frames takes the short way around
+			 */
+			prev = frm - stride;
+			for(i=0; i<num_nodes; i++) {
+				float dot = 0.0f;
+				qprev = prev + ANM_TRACK_ROT_X * num_nodes + i;
+				qcur = frm + ANM_TRACK_ROT_X * num_nodes + i;
+				for(j=0; j<4; j++) {
+					dot += qprev[j * num_nodes] * qcur[j * num_nodes];
+				}
+				if(dot < 0.0f) {
+					for(j=0; j<4; j++) {
+						qcur[j * num_nodes] = -qcur[j * num_nodes];
+					}
+				}
+			}
+		}
+	}
+
+	g3dimpl_free(cursors);
+	return 0;
+}
+
+void g3dimpl_sample_baked(const struct goat3d_baked_anim *ba, float *res, long tmsec)
+{
+	int i, f, n, stride, last;
+	float t;
+	const float *a, *b;
+	float *qx, *qy, *qz, *qw;
+
+	n = ba->num_nodes;
+	stride = ANM_NUM_TRACKS * n;
+	last = ba->num_frames - 1;
+
+	if(tmsec <= ba->tstart) {
+		f = 0;
+		t = 0.0f;
+	} else if(tmsec >= ba->times[last]) {
+		f = last;
+		t = 0.0f;
+	} else {
+		/* frames are uniformly spaced except for rounding and the clamped last
+		 * frame, so start from the frame computed from the rate and walk to
+		 * the interval that really contains tmsec
+		 */
+		f = (int)((double)(tmsec - ba->tstart) * ba->rate / 1000.0);
+		if(f > last - 1) f = last - 1;
+		while(f > 0 && ba->times[f] > tmsec) f--;
+		while(ba->times[f + 1] <= tmsec) f++;
+		t = (float)(tmsec - ba->times[f]) / (float)(ba->times[f + 1] - ba->times[f]);
+	}
+
+	a = ba->frames + (size_t)f * stride;
+	if(t == 0.0f) {
+		memcpy(res, a, stride * sizeof *res);
+		return;
+	}
+	b = a + stride;
+
+	/* lerp all components of all nodes in one go */
+	i = 0;
+#ifdef __SSE__
+	{
+		__m128 vt = _mm_set1_ps(t);
+		for(; i<(stride & ~3); i+=4) {
+			__m128 va = _mm_loadu_ps(a + i);
+			__m128 vb = _mm_loadu_ps(b + i);
+			_mm_storeu_ps(res + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+		}
+	}
+#endif
+	for(; i<stride; i++) {
+		res[i] = a[i] + (b[i] - a[i]) * t;
+	}
+
+	/* renormalize the rotations to complete the nlerp */
+	qx = res + ANM_TRACK_ROT_X * n;
+	qy = res + ANM_TRACK_ROT_Y * n;
+	qz = res + ANM_TRACK_ROT_Z * n;
+	qw = res + ANM_TRACK_ROT_W * n;
+
+	i = 0;
+#ifdef __SSE__
+	for(; i<(n & ~3); i+=4) {
+		__m128 x = _mm_loadu_ps(qx + i);
+		__m128 y = _mm_loadu_ps(qy + i);
+		__m128 z = _mm_loadu_ps(qz + i);
+		__m128 w = _mm_loadu_ps(qw + i);
+		__m128 len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+				_mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		len = _mm_sqrt_ps(len);
+		_mm_storeu_ps(qx + i, _mm_div_ps(x, len));
+		_mm_storeu_ps(qy + i, _mm_div_ps(y, len));
+		_mm_storeu_ps(qz + i, _mm_div_ps(z, len));
+		_mm_storeu_ps(qw + i, _mm_div_ps(w, len));
+	}
+#endif
+	for(; i<n; i++) {
+		float s = 1.0f / sqrt(qx[i] * qx[i] + qy[i] * qy[i] + qz[i] * qz[i] + qw[i] * qw[i]);
+		qx[i] *= s;
+		qy[i] *= s;
+		qz[i] *= s;
+		qw[i] *= s;
+	}
+}
+
+void g3dimpl_anim_trs(struct anm_node *node, int anim_idx, anm_time_t tm, int *cursor,
+		cgm_vec3 *pos, cgm_quat *rot, cgm_vec3 *scale)
+{
+	int i;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+
+	if(anim_idx < 0 || !(anim = anm_get_animation(node, anim_idx))) {
+		cgm_vcons(pos, 0, 0, 0);
+		cgm_qcons(rot, 0, 0, 0, 1);
+		cgm_vcons(scale, 1, 1, 1);
+		return;
+	}
+
+	for(i=0; i<3; i++) {
+		trk = anim->tracks + ANM_TRACK_POS_X + i;
+		(&pos->x)[i] = g3dimpl_track_value(trk, g3dimpl_remap_time(trk, tm),
+				cursor ? cursor + ANM_TRACK_POS_X + i : 0);
+		trk = anim->tracks + ANM_TRACK_SCL_X + i;
+		(&scale->x)[i] = g3dimpl_track_value(trk, g3dimpl_remap_time(trk, tm),
+				cursor ? cursor + ANM_TRACK_SCL_X + i : 0);
+	}
+	trk = anim->tracks + ANM_TRACK_ROT_X;
+	g3dimpl_track_rotation(trk, g3dimpl_remap_time(trk, tm),
+			cursor ? cursor + ANM_TRACK_ROT_X : 0, rot);
+}
+
+/* same composition as libanim: T(pos + pivot) * R * S * T(-pivot) */
+void g3dimpl_trs_matrix(float *m, const cgm_vec3 *pos, const cgm_quat *rot,
+		const cgm_vec3 *scale, const float *pivot)
+{
+	float xx = rot->x * rot->x, yy = rot->y * rot->y, zz = rot->z * rot->z;
+	float xy = rot->x * rot->y, xz = rot->x * rot->z, yz = rot->y * rot->z;
+	float wx = rot->w * rot->x, wy = rot->w * rot->y, wz = rot->w * rot->z;
+
+	m[0] = (1.0f - 2.0f * (yy + zz)) * scale->x;
+	m[1] = 2.0f * (xy + wz) * scale->x;
+	m[2] = 2.0f * (xz - wy) * scale->x;
+	m[3] = 0.0f;
+	m[4] = 2.0f * (xy - wz) * scale->y;
+	m[5] = (1.0f - 2.0f * (xx + zz)) * scale->y;
+	m[6] = 2.0f * (yz + wx) * scale->y;
+	m[7] = 0.0f;
+	m[8] = 2.0f * (xz + wy) * scale->z;
+	m[9] = 2.0f * (yz - wx) * scale->z;
+	m[10] = (1.0f - 2.0f * (xx + yy)) * scale->z;
+	m[11] = 0.0f;
+	m[12] = pos->x + pivot[0] - (m[0] * pivot[0] + m[4] * pivot[1] + m[8] * pivot[2]);
+	m[13] = pos->y + pivot[1] - (m[1] * pivot[0] + m[5] * pivot[1] + m[9] * pivot[2]);
+	m[14] = pos->z + pivot[2] - (m[2] * pivot[0] + m[6] * pivot[1] + m[10] * pivot[2]);
+	m[15] = 1.0f;
+}
+
+int g3dimpl_eval_anim_jobs(struct goat3d_node **nodes, int num_nodes,
+		struct goat3d_anim_job *jobs, int num_jobs)
+{
+	int i, head, tail;
+	struct eval_context ctx;
+	struct nodeptr *ptrs, key, *found;
+	struct anm_node *c;
+
+	if(!(ptrs = g3dimpl_malloc((num_nodes + 1) * sizeof *ptrs))) {
+		return -1;
+	}
+	if(!(ctx.parent = g3dimpl_malloc((num_nodes + 1) * 2 * sizeof *ctx.parent))) {
+		g3dimpl_free(ptrs);
+		return -1;
+	}
+	ctx.order = ctx.parent + num_nodes;
+
+	/* find the parent index of each node, and order the nodes so that parents
+	 * are always evaluated before their children
+	 */
+	for(i=0; i<num_nodes; i++) {
+		ptrs[i].node = &nodes[i]->anm;
+		ptrs[i].idx = i;
+	}
+	qsort(ptrs, num_nodes, sizeof *ptrs, cmp_nodeptr);
+
+	tail = 0;
+	for(i=0; i<num_nodes; i++) {
+		ctx.parent[i] = -1;
+		if((key.node = nodes[i]->anm.parent)) {
+			if((found = bsearch(&key, ptrs, num_nodes, sizeof *ptrs, cmp_nodeptr))) {
+				ctx.parent[i] = found->idx;
+			}
+		}
+		if(ctx.parent[i] == -1) {
+			ctx.order[tail++] = i;
+		}
+	}
+	for(head=0; head<tail; head++) {
+		c = nodes[ctx.order[head]]->anm.child;
+		while(c) {
+			key.node = c;
+			if((found = bsearch(&key, ptrs, num_nodes, sizeof *ptrs, cmp_nodeptr))) {
+				ctx.order[tail++] = found->idx;
+			}
+			c = c->next;
+		}
+	}
+	g3dimpl_free(ptrs);
+
+	ctx.nodes = nodes;
+	ctx.num_nodes = tail;
+	ctx.jobs = jobs;
+
+	g3dimpl_parallel_for(num_jobs, eval_job, &ctx);
+
+	g3dimpl_free(ctx.parent);
+	return 0;
+}
+
+/* returns the index i of the key interval [i, i+1) containing tm.
+ * expects at least 2 keys, and tm inside the keyframe range of the track.
+ */
+static int key_interval(const struct anm_track *trk, anm_time_t tm, int *cursor)
+{
+	int lo, hi, mid, step, last = trk->count - 1;
+	const struct anm_keyframe *keys = trk->keys;
+
+	/* cursors are only hints, shared by every thread evaluating the same
+	 * node. Any value read is validated before use, relaxed atomics only make
+	 * sure it's not torn.
+	 */
+	lo = cursor ? g3dimpl_relaxed_load(cursor) : -1;
+	if(lo >= 0 && lo < last && keys[lo].time <= tm) {
+		/* gallop forward from the last interval. Usually we're still in the
+		 * same interval, or the next one, which makes this O(1) during playback.
+		 */
+		step = 1;
+		while(lo + step < last && keys[lo + step].time <= tm) {
+			lo += step;
+			step <<= 1;
+		}
+		hi = lo + step < last ? lo + step : last;
+	} else {
+		lo = 0;
+		hi = last;
+	}
+
+	/* invariant: keys[lo].time <= tm < keys[hi].time */
+	while(hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if(keys[mid].time <= tm) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if(cursor) g3dimpl_relaxed_store(cursor, lo);
+	return lo;
+}
+
+/* the cursor fast paths only apply when a single animation is active,
+ * blending between two animations is left to libanim
+ */
+static struct anm_animation *single_anim(struct goat3d_node *node)
+{
+	if(anm_get_active_animation(&node->anm, 1)) {
+		return 0;
+	}
+	return anm_get_active_animation(&node->anm, 0);
+}
+
+/* samples all tracks of one node, writing each component cstride floats apart */
+static void bake_node(float *dest, int cstride, struct anm_node *node, int anim_idx,
+		anm_time_t tm, int *cursor)
+{
+	cgm_vec3 pos, scale;
+	cgm_quat rot;
+
+	g3dimpl_anim_trs(node, anim_idx, tm, cursor, &pos, &rot, &scale);
+
+	dest[ANM_TRACK_POS_X * cstride] = pos.x;
+	dest[ANM_TRACK_POS_Y * cstride] = pos.y;
+	dest[ANM_TRACK_POS_Z * cstride] = pos.z;
+	dest[ANM_TRACK_ROT_X * cstride] = rot.x;
+	dest[ANM_TRACK_ROT_Y * cstride] = rot.y;
+	dest[ANM_TRACK_ROT_Z * cstride] = rot.z;
+	dest[ANM_TRACK_ROT_W * cstride] = rot.w;
+	dest[ANM_TRACK_SCL_X * cstride] = scale.x;
+	dest[ANM_TRACK_SCL_Y * cstride] = scale.y;
+	dest[ANM_TRACK_SCL_Z * cstride] = scale.z;
+}
+
+/* column-major 4x4 matrix multiplication: res = a * b */
+void g3dimpl_mat_mul(float *res, const float *a, const float *b)
+{
+	int i, j;
+	for(i=0; i<4; i++) {
+		for(j=0; j<4; j++) {
+			res[i * 4 + j] = a[j] * b[i * 4] + a[4 + j] * b[i * 4 + 1] +
+				a[8 + j] * b[i * 4 + 2] + a[12 + j] * b[i * 4 + 3];
+		}
+	}
+}
+
+static int cmp_nodeptr(const void *a, const void *b)
+{
+	const struct nodeptr *pa = a;
+	const struct nodeptr *pb = b;
+	if(pa->node == pb->node) return 0;
+	return pa->node < pb->node ? -1 : 1;
+}
+
+static void eval_job(int idx, void *cls)
+{
+	int i, n;
+	struct eval_context *ctx = cls;
+	struct goat3d_anim_job *job = ctx->jobs + idx;
+	struct anm_node *node;
+	anm_time_t tm = ANM_MSEC2TM(job->tmsec);
+	float local[16], pivot[3], *mat;
+	cgm_vec3 pos, scale, pos1, scale1;
+	cgm_quat rot, rot0, rot1;
+
+	for(i=0; i<ctx->num_nodes; i++) {
+		n = ctx->order[i];
+		node = &ctx->nodes[n]->anm;
+
+		g3dimpl_anim_trs(node, job->anim[0], tm, 0, &pos, &rot, &scale);
+		if(job->anim[1] >= 0 && job->mix > 0.0f) {
+			float t = job->mix;
+			g3dimpl_anim_trs(node, job->anim[1], tm, 0, &pos1, &rot1, &scale1);
+			pos.x += (pos1.x - pos.x) * t;
+			pos.y += (pos1.y - pos.y) * t;
+			pos.z += (pos1.z - pos.z) * t;
+			scale.x += (scale1.x - scale.x) * t;
+			scale.y += (scale1.y - scale.y) * t;
+			scale.z += (scale1.z - scale.z) * t;
+			rot0 = rot;
+			cgm_qslerp(&rot, &rot0, &rot1, t);
+		}
+		anm_get_pivot(node, pivot, pivot + 1, pivot + 2);
+
+		mat = job->matrices + n * 16;
+		if(ctx->parent[n] == -1) {
+			g3dimpl_trs_matrix(mat, &pos, &rot, &scale, pivot);
+		} else {
+			g3dimpl_trs_matrix(local, &pos, &rot, &scale, pivot);
+			g3dimpl_mat_mul(mat, job->matrices + ctx->parent[n] * 16, local);
+		}
+	}
+}
@@ -0,0 +1,121 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef G3DANM_H_
+#define G3DANM_H_
+
+#include <anim/anim.h>
+#include <cgmath/cgmath.h>
+#include "object.h"
+
+/* node animation attributes, each driven by 3 or 4 consecutive tracks */
+enum { POSITION_TRACK, ROTATION_TRACK, SCALING_TRACK };
+
+extern const int g3dimpl_track_base[];		/* first ANM_TRACK_* of each attribute */
+extern const int g3dimpl_track_nelem[];		/* number of tracks of each attribute */
+
+/* null-terminated name tables, as used in animation files */
+extern const char *g3dimpl_track_attr_names[];
+extern const char *g3dimpl_interp_names[];
+extern const char *g3dimpl_extrap_names[];
+
+/* returns the index of str in a null-terminated name table, or -1 */
+int g3dimpl_find_name(const char **names, const char *str);
+
+struct key {
+	long tm;
+	cgm_vec4 val;
+};
+
+/* keyframe sampling with cursors.
+ * A cursor is an int per track remembering the last bracketing key interval,
+ * so that sampling at monotonically increasing times (the usual case during
+ * playback) finds the next interval in amortized constant time, instead of
+ * searching the whole keyframe array each time. Cursors are only hints, any
+ * value is valid (including a null cursor pointer, which disables caching).
+ */
+float g3dimpl_track_value(struct anm_track *trk, anm_time_t tm, int *cursor);
+/* evaluates the quaternion formed by the 4 rotation tracks starting at trk */
+void g3dimpl_track_rotation(struct anm_track *trk, anm_time_t tm, int *cursor, cgm_quat *res);
+
+/* true if tm falls inside the keyframe range of the track, where the
+ * extrapolation mode of the track doesn't come into play
+ */
+int g3dimpl_track_inrange(const struct anm_track *trk, anm_time_t tm);
+
+/* node-level sampling of the active animation, using the node key cursors */
+void g3dimpl_node_position(struct goat3d_node *node, float *res, anm_time_t tm);
+void g3dimpl_node_rotation(struct goat3d_node *node, float *res, anm_time_t tm);
+void g3dimpl_node_scaling(struct goat3d_node *node, float *res, anm_time_t tm);
+
+/* maps tm into the keyframe range of the track for repeat and pingpong
+ * extrapolation. extend and clamp are left as-is, since sampling past the
+ * ends of a track already yields the first or last key.
+ */
+anm_time_t g3dimpl_remap_time(const struct anm_track *trk, anm_time_t tm);
+
+/* animation resampled at a fixed rate into structure-of-arrays form.
+ * Each frame holds ANM_NUM_TRACKS components (indexed by ANM_TRACK_*), and each
+ * component is an array of num_nodes floats, in scene node order:
+ * frames[(frame * ANM_NUM_TRACKS + component) * num_nodes + node]
+ * times holds the time of each frame: frame times are rounded to milliseconds,
+ * and the last frame is clamped to tend, so they're not exactly uniform.
+ */
+struct goat3d_baked_anim {
+	int num_nodes, num_frames;
+	long tstart, tend;
+	float rate;
+	float *frames;
+	long *times;
+};
+
+int g3dimpl_bake_anim(struct goat3d_baked_anim *ba, struct goat3d_node **nodes,
+		int num_nodes, int anim_idx, float rate_hz);
+void g3dimpl_sample_baked(const struct goat3d_baked_anim *ba, float *res, long tmsec);
+
+/* samples the position, rotation, and scaling of a node for any of its
+ * animations, without touching the active animation state of the node.
+ * cursor, if not null, points to ANM_NUM_TRACKS key cursors.
+ */
+void g3dimpl_anim_trs(struct anm_node *node, int anim_idx, anm_time_t tm, int *cursor,
+		cgm_vec3 *pos, cgm_quat *rot, cgm_vec3 *scale);
+/* builds a column-major node matrix, composed like libanim node matrices */
+void g3dimpl_trs_matrix(float *mat, const cgm_vec3 *pos, const cgm_quat *rot,
+		const cgm_vec3 *scale, const float *pivot);
+
+/* column-major 4x4 matrix multiplication: res = a * b, res must not alias a or b */
+void g3dimpl_mat_mul(float *res, const float *a, const float *b);
+
+/* evaluates the world matrices of all nodes for each job, in parallel */
+int g3dimpl_eval_anim_jobs(struct goat3d_node **nodes, int num_nodes,
+		struct goat3d_anim_job *jobs, int num_jobs);
+
+/* animation keyframe compression (anmcomp.c)
+ * reduce_keys drops keys which can be reconstructed by interpolating between
+ * the keys around them, within tol. returns the new key count. Only valid for
+ * linearly interpolated tracks.
+ * pack_keys quantizes the keys and returns them as a base64 string, see
+ * doc/goatanimfmt for the packed layout. vmin/vmax are computed for vector
+ * keys (ignored for rotations), and are needed for unpacking.
+ * unpack_keys fails if str is too short to hold count keys.
+ */
+int g3dimpl_reduce_keys(struct key *keys, int count, int rot, float tol);
+char *g3dimpl_pack_keys(const struct key *keys, int count, int rot, cgm_vec3 *vmin, cgm_vec3 *vmax);
+int g3dimpl_unpack_keys(struct key *keys, int count, const char *str, int rot,
+		const cgm_vec3 *vmin, const cgm_vec3 *vmax);
+
+#endif	/* G3DANM_H_ */
@@ -0,0 +1,58 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_ATOMIC_H_
+#define GOAT3D_ATOMIC_H_
+
+/* minimal set of atomic operations on ints (and loads/stores of pointers).
+ * add and cas imply a full memory barrier, load/store have acquire/release
+ * semantics, and the relaxed variants only guarantee that the value isn't
+ * torn.
+ */
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+#define g3dimpl_atomic_add(p, x)	(_InterlockedExchangeAdd((long volatile*)(p), (x)) + (x))
+#define g3dimpl_atomic_cas(p, cmp, x) \
+	(_InterlockedCompareExchange((long volatile*)(p), (x), (cmp)) == (cmp))
+
+/* msvc volatile accesses have acquire/release semantics */
+#define g3dimpl_atomic_load(p)		(*(volatile int*)(p))
+#define g3dimpl_atomic_store(p, x)	(*(volatile int*)(p) = (x))
+#define g3dimpl_relaxed_load(p)		(*(volatile int*)(p))
+#define g3dimpl_relaxed_store(p, x)	(*(volatile int*)(p) = (x))
+#define g3dimpl_atomic_loadp(p)		(*(void * volatile*)(p))
+#define g3dimpl_atomic_storep(p, x)	(*(void * volatile*)(p) = (x))
+
+#else	/* gcc and compatible compilers */
+
+/* adds x to *p and returns the new value */
+#define g3dimpl_atomic_add(p, x)	__sync_add_and_fetch((p), (x))
+/* sets *p to x if it's equal to cmp, returns non-zero on success */
+#define g3dimpl_atomic_cas(p, cmp, x)	__sync_bool_compare_and_swap((p), (cmp), (x))
+
+#define g3dimpl_atomic_load(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define g3dimpl_atomic_store(p, x)	__atomic_store_n((p), (x), __ATOMIC_RELEASE)
+#define g3dimpl_relaxed_load(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define g3dimpl_relaxed_store(p, x)	__atomic_store_n((p), (x), __ATOMIC_RELAXED)
+/* acquire/release load/store of pointers */
+#define g3dimpl_atomic_loadp(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define g3dimpl_atomic_storep(p, x)	__atomic_store_n((p), (x), __ATOMIC_RELEASE)
+
+#endif
+
+#endif	/* GOAT3D_ATOMIC_H_ */
@@ -18,25 +18,36 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <treestore.h>
 #include "goat3d.h"
 #include "goat3d_impl.h"
 #include "log.h"
 #include "dynarr.h"
+#include "g3danm.h"
+#include "g3datomic.h"
+#include "summary.h"
 
 static long read_file(void *buf, size_t bytes, void *uptr);
 static long write_file(const void *buf, size_t bytes, void *uptr);
 static long seek_file(long offs, int whence, void *uptr);
 static char *clean_filename(char *str);
 
+struct memio {
+	char *wbuf;
+	size_t size, max;
+};
+static long read_mem(void *buf, size_t bytes, void *uptr);
+static long write_mem(const void *buf, size_t bytes, void *uptr);
+
 GOAT3DAPI struct goat3d *goat3d_create(void)
 {
 	struct goat3d *g;
 
-	if(!(g = malloc(sizeof *g))) {
+	if(!(g = g3dimpl_malloc(sizeof *g))) {
 		return 0;
 	}
 	if(goat3d_init(g) == -1) {
-		free(g);
+		g3dimpl_free(g);
 		return 0;
 	}
 	return g;
@@ -45,13 +56,15 @@ GOAT3DAPI struct goat3d *goat3d_create(void)
 GOAT3DAPI void goat3d_free(struct goat3d *g)
 {
 	goat3d_destroy(g);
-	free(g);
+	g3dimpl_free(g);
 }
 
 int goat3d_init(struct goat3d *g)
 {
 	memset(g, 0, sizeof *g);
 
+	if(!(g->arena = g3dimpl_arena_create())) goto err;
+	if(!(g->shared_arenas = dynarr_alloc(0, sizeof *g->shared_arenas))) goto err;
 	if(goat3d_set_name(g, "unnamed") == -1) goto err;
 	cgm_vcons(&g->ambient, 0.05, 0.05, 0.05);
 
@@ -77,49 +90,98 @@ void goat3d_destroy(struct goat3d *g)
 	dynarr_free(g->lights);
 	dynarr_free(g->cameras);
 	dynarr_free(g->nodes);
+
+	dynarr_free(g->shared_arenas);
+	g3dimpl_arena_release(g->arena);
+
+	g3dimpl_free(g->search_path);
 }
 
 void goat3d_clear(struct goat3d *g)
 {
 	int i, num;
 
+	/* objects allocated from the scene arena are released all together at the
+	 * end, only the rest need to be destroyed one by one
+	 */
 	num = dynarr_size(g->materials);
 	for(i=0; i<num; i++) {
+		if(g->materials[i]->arena) continue;
 		g3dimpl_mtl_destroy(g->materials[i]);
-		free(g->materials[i]);
+		g3dimpl_free(g->materials[i]);
 	}
 	DYNARR_CLEAR(g->materials);
 
 	num = dynarr_size(g->meshes);
 	for(i=0; i<num; i++) {
+		if(g->meshes[i]->arena) continue;
 		g3dimpl_obj_destroy((struct object*)g->meshes[i]);
-		free(g->meshes[i]);
+		g3dimpl_free(g->meshes[i]);
 	}
 	DYNARR_CLEAR(g->meshes);
 
 	num = dynarr_size(g->lights);
 	for(i=0; i<num; i++) {
+		if(g->lights[i]->arena) continue;
 		g3dimpl_obj_destroy((struct object*)g->lights[i]);
-		free(g->lights[i]);
+		g3dimpl_free(g->lights[i]);
 	}
 	DYNARR_CLEAR(g->lights);
 
 	num = dynarr_size(g->cameras);
 	for(i=0; i<num; i++) {
+		if(g->cameras[i]->arena) continue;
 		g3dimpl_obj_destroy((struct object*)g->cameras[i]);
-		free(g->cameras[i]);
+		g3dimpl_free(g->cameras[i]);
 	}
 	DYNARR_CLEAR(g->cameras);
 
 	num = dynarr_size(g->nodes);
 	for(i=0; i<num; i++) {
 		anm_destroy_node(&g->nodes[i]->anm);
-		free(g->nodes[i]);
+		g3dimpl_free(g->nodes[i]);
 	}
 	DYNARR_CLEAR(g->nodes);
 
+	if(g->shared_arenas) {
+		num = dynarr_size(g->shared_arenas);
+		for(i=0; i<num; i++) {
+			g3dimpl_arena_release(g->shared_arenas[i]);
+		}
+		DYNARR_CLEAR(g->shared_arenas);
+	}
+
+	if(g->arena) {
+		if(g3dimpl_arena_shared(g->arena)) {
+			/* clones of this scene still use data from our arena, leave it to
+			 * them and start over with a new one
+			 */
+			struct arena *a = g3dimpl_arena_create();
+			if(a) {
+				a->mem = g->arena->mem;
+				g3dimpl_arena_release(g->arena);
+				g->arena = a;
+			}
+		} else {
+			g3dimpl_arena_clear(g->arena);
+		}
+	}
+
 	goat3d_set_name(g, "unnamed");
-	g->bbox_valid = 0;
+	g->bbox_valid = BBOX_INVALID;
+}
+
+GOAT3DAPI void goat3d_set_scene_allocator(struct goat3d *g, goat3d_alloc_func alloc_func,
+		goat3d_realloc_func realloc_func, goat3d_free_func free_func, void *cls)
+{
+	if(!alloc_func || !realloc_func || !free_func) {
+		memset(&g->arena->mem, 0, sizeof g->arena->mem);
+		return;
+	}
+	g->arena->mem.alloc = alloc_func;
+	g->arena->mem.realloc = realloc_func;
+	g->arena->mem.free = free_func;
+	g->arena->mem.cls = cls;
 }
 
 GOAT3DAPI void goat3d_setopt(struct goat3d *g, enum goat3d_option opt, int val)
@@ -138,22 +200,37 @@ GOAT3DAPI int goat3d_getopt(const struct goat3d *g, enum goat3d_option opt)
 
 GOAT3DAPI int goat3d_load(struct goat3d *g, const char *fname)
 {
-	int len, res;
-	char *slash;
+	int res;
 	FILE *fp = fopen(fname, "rb");
 	if(!fp) {
 		goat3d_logmsg(LOG_ERROR, "failed to open file \"%s\" for reading: %s\n", fname, strerror(errno));
 		return -1;
 	}
 
-	/* if the filename contained any directory components, keep the prefix
-	 * to use it as a search path for external mesh file loading
-	 */
-	len = strlen(fname);
-	if(!(g->search_path = malloc(len + 1))) {
+	if(g3dimpl_set_search_path(g, fname) == -1) {
 		fclose(fp);
 		return -1;
 	}
+
+	res = goat3d_load_file(g, fp);
+	fclose(fp);
+	return res;
+}
+
+/* if the filename contained any directory components, keep the prefix
+ * to use it as a search path for external mesh file loading
+ */
+int g3dimpl_set_search_path(struct goat3d *g, const char *fname)
+{
+	int len;
+	char *slash;
+
+	g3dimpl_free(g->search_path);
+
+	len = strlen(fname);
+	if(!(g->search_path = g3dimpl_malloc(len + 1))) {
+		return -1;
+	}
 	memcpy(g->search_path, fname, len + 1);
 
 	if((slash = strrchr(g->search_path, '/'))) {
@@ -162,14 +239,11 @@ GOAT3DAPI int goat3d_load(struct goat3d *g, const char *fname)
 		if((slash = strrchr(g->search_path, '\\'))) {
 			*slash = 0;
 		} else {
-			free(g->search_path);
+			g3dimpl_free(g->search_path);
 			g->search_path = 0;
 		}
 	}
-
-	res = goat3d_load_file(g, fp);
-	fclose(fp);
-	return res;
+	return 0;
 }
 
 GOAT3DAPI int goat3d_save(const struct goat3d *g, const char *fname)
@@ -218,12 +292,67 @@ GOAT3DAPI int goat3d_save_io(const struct goat3d *g, struct goat3d_io *io)
 	if(goat3d_getopt(g, GOAT3D_OPT_SAVEXML)) {
 		goat3d_logmsg(LOG_ERROR, "saving in the original xml format is no longer supported\n");
 		return -1;
-	} else if(goat3d_getopt(g, GOAT3D_OPT_SAVETEXT)) {
-		/* TODO set treestore output format as text */
 	}
 	return g3dimpl_scnsave(g, io);
 }
 
+GOAT3DAPI int goat3d_verify(const char *fname)
+{
+	int res;
+	struct goat3d_io io;
+	FILE *fp = fopen(fname, "rb");
+	if(!fp) {
+		goat3d_logmsg(LOG_ERROR, "failed to open file \"%s\" for reading: %s\n", fname, strerror(errno));
+		return -1;
+	}
+
+	io.cls = fp;
+	io.read = read_file;
+	io.write = write_file;
+	io.seek = seek_file;
+
+	res = goat3d_verify_io(&io);
+	fclose(fp);
+	return res;
+}
+
+GOAT3DAPI int goat3d_verify_io(struct goat3d_io *io)
+{
+	return g3dimpl_verify_file(io);
+}
+
+/* memory buffers are parsed and written directly, without going through the
+ * I/O buffering layer
+ */
+GOAT3DAPI int goat3d_load_mem(struct goat3d *g, const void *buf, size_t size)
+{
+	return g3dimpl_scnload_mem(g, buf, size);
+}
+
+GOAT3DAPI int goat3d_save_mem(const struct goat3d *g, void **bufret, size_t *sizeret)
+{
+	struct memio mem;
+	struct ts_io tsio;
+
+	if(goat3d_getopt(g, GOAT3D_OPT_SAVEXML)) {
+		goat3d_logmsg(LOG_ERROR, "saving in the original xml format is no longer supported\n");
+		return -1;
+	}
+
+	memset(&mem, 0, sizeof mem);
+	tsio.data = &mem;
+	tsio.read = read_mem;
+	tsio.write = write_mem;
+
+	if(g3dimpl_scnsave_tsio(g, &tsio) == -1) {
+		g3dimpl_free(mem.wbuf);
+		return -1;
+	}
+	*bufret = mem.wbuf;
+	*sizeret = mem.size;
+	return 0;
+}
+
 /* save/load animations */
 GOAT3DAPI int goat3d_load_anim(struct goat3d *g, const char *fname)
 {
@@ -285,8 +414,6 @@ GOAT3DAPI int goat3d_save_anim_io(const struct goat3d *g, struct goat3d_io *io)
 	if(goat3d_getopt(g, GOAT3D_OPT_SAVEXML)) {
 		goat3d_logmsg(LOG_ERROR, "saving in the original xml format is no longer supported\n");
 		return -1;
-	} else if(goat3d_getopt(g, GOAT3D_OPT_SAVETEXT)) {
-		/* TODO set treestore save format as text */
 	}
 	return g3dimpl_anmsave(g, io);
 }
@@ -296,8 +423,8 @@ GOAT3DAPI int goat3d_set_name(struct goat3d *g, const char *name)
 {
 	int len = strlen(name);
 
-	free(g->name);
-	if(!(g->name = malloc(len + 1))) {
+	g3dimpl_free(g->name);
+	if(!(g->name = g3dimpl_malloc(len + 1))) {
 		return -1;
 	}
 	memcpy(g->name, name, len + 1);
@@ -327,10 +454,13 @@ GOAT3DAPI const float *goat3d_get_ambient(const struct goat3d *g)
 GOAT3DAPI int goat3d_get_bounds(const struct goat3d *g, float *bmin, float *bmax)
 {
 	int i, num_nodes;
-	struct aabox node_bbox;
+	struct aabox bbox, node_bbox;
+	struct goat3d *gw = (struct goat3d*)g;
 
-	if(!g->bbox_valid) {
-		g3dimpl_aabox_init((struct aabox*)&g->bbox);
+	if(g3dimpl_atomic_load(&g->bbox_valid) == BBOX_VALID) {
+		bbox = g->bbox;
+	} else {
+		g3dimpl_aabox_init(&bbox);
 
 		num_nodes = dynarr_size(g->nodes);
 		for(i=0; i<num_nodes; i++) {
@@ -338,17 +468,22 @@ GOAT3DAPI int goat3d_get_bounds(const struct goat3d *g, float *bmin, float *bmax
 				continue;
 			}
 			g3dimpl_node_bounds(&node_bbox, &g->nodes[i]->anm);
-			g3dimpl_aabox_union((struct aabox*)&g->bbox, &g->bbox, &node_bbox);
+			g3dimpl_aabox_union(&bbox, &bbox, &node_bbox);
+		}
+
+		/* only one thread gets to publish the result */
+		if(g3dimpl_atomic_cas(&gw->bbox_valid, BBOX_INVALID, BBOX_UPDATING)) {
+			gw->bbox = bbox;
+			g3dimpl_atomic_store(&gw->bbox_valid, BBOX_VALID);
 		}
-		((struct goat3d*)g)->bbox_valid = 1;
 	}
 
-	bmin[0] = g->bbox.bmin.x;
-	bmin[1] = g->bbox.bmin.y;
-	bmin[2] = g->bbox.bmin.z;
-	bmax[0] = g->bbox.bmax.x;
-	bmax[1] = g->bbox.bmax.y;
-	bmax[2] = g->bbox.bmax.z;
+	bmin[0] = bbox.bmin.x;
+	bmin[1] = bbox.bmin.y;
+	bmin[2] = bbox.bmin.z;
+	bmax[0] = bbox.bmax.x;
+	bmax[1] = bbox.bmax.y;
+	bmax[2] = bbox.bmax.z;
 	return 0;
 }
 
@@ -387,28 +522,27 @@ GOAT3DAPI struct goat3d_material *goat3d_get_mtl_by_name(struct goat3d *g, const
 GOAT3DAPI struct goat3d_material *goat3d_create_mtl(void)
 {
 	struct goat3d_material *mtl;
-	if(!(mtl = malloc(sizeof *mtl))) {
+	if(!(mtl = g3dimpl_malloc(sizeof *mtl))) {
 		return 0;
 	}
-	g3dimpl_mtl_init(mtl);
+	g3dimpl_mtl_init(mtl, 0);
 	return mtl;
 }
 
 GOAT3DAPI void goat3d_destroy_mtl(struct goat3d_material *mtl)
 {
+	if(mtl->arena) return;	/* owned by a scene */
 	g3dimpl_mtl_destroy(mtl);
-	free(mtl);
+	g3dimpl_free(mtl);
 }
 
 GOAT3DAPI int goat3d_set_mtl_name(struct goat3d_material *mtl, const char *name)
 {
 	char *tmp;
-	int len = strlen(name);
-	if(!(tmp = malloc(len + 1))) {
+	if(!(tmp = g3dimpl_astrdup(mtl->arena, name))) {
 		return -1;
 	}
-	memcpy(tmp, name, len + 1);
-	free(mtl->name);
+	g3dimpl_afree(mtl->arena, mtl->name);
 	mtl->name = tmp;
 	return 0;
 }
@@ -457,16 +591,15 @@ GOAT3DAPI int goat3d_set_mtl_attrib_map(struct goat3d_material *mtl, const char
 	struct material_attrib *ma;
 
 	len = strlen(mapname);
-	if(!(tmp = malloc(len + 1))) {
+	if(!(tmp = g3dimpl_astrdup(mtl->arena, mapname))) {
 		return -1;
 	}
-	memcpy(tmp, mapname, len + 1);
 
 	if(!(ma = g3dimpl_mtl_getattr(mtl, attrib))) {
-		free(tmp);
+		g3dimpl_afree(mtl->arena, tmp);
 		return -1;
 	}
-	free(ma->map);
+	g3dimpl_afree(mtl->arena, ma->map);
 	ma->map = tmp;
 	tmp = clean_filename(ma->map);
 	if(tmp != ma->map) {
@@ -478,7 +611,27 @@ GOAT3DAPI int goat3d_set_mtl_attrib_map(struct goat3d_material *mtl, const char
 GOAT3DAPI const char *goat3d_get_mtl_attrib_map(struct goat3d_material *mtl, const char *attrib)
 {
 	struct material_attrib *ma = g3dimpl_mtl_findattr(mtl, attrib);
-	return ma->map;
+	return ma ? ma->map : 0;
+}
+
+GOAT3DAPI int goat3d_set_mtl_attrib_atom(struct goat3d_material *mtl, int atom, const float *val)
+{
+	struct material_attrib *ma = g3dimpl_mtl_getattr_atom(mtl, atom);
+	if(!ma) return -1;
+	cgm_wcons(&ma->value, val[0], val[1], val[2], val[3]);
+	return 0;
+}
+
+GOAT3DAPI const float *goat3d_get_mtl_attrib_atom(struct goat3d_material *mtl, int atom)
+{
+	struct material_attrib *ma = g3dimpl_mtl_findattr_atom(mtl, atom);
+	return ma ? &ma->value.x : 0;
+}
+
+GOAT3DAPI const char *goat3d_get_mtl_attrib_map_atom(struct goat3d_material *mtl, int atom)
+{
+	struct material_attrib *ma = g3dimpl_mtl_findattr_atom(mtl, atom);
+	return ma ? ma->map : 0;
 }
 
 // ---- meshes ----
@@ -517,11 +670,11 @@ GOAT3DAPI struct goat3d_mesh *goat3d_create_mesh(void)
 {
 	struct goat3d_mesh *m;
 
-	if(!(m = malloc(sizeof *m))) {
+	if(!(m = g3dimpl_malloc(sizeof *m))) {
 		return 0;
 	}
-	if(g3dimpl_obj_init((struct object*)m, OBJTYPE_MESH) == -1) {
-		free(m);
+	if(g3dimpl_obj_init((struct object*)m, OBJTYPE_MESH, 0) == -1) {
+		g3dimpl_free(m);
 		return 0;
 	}
 	return m;
@@ -529,20 +682,21 @@ GOAT3DAPI struct goat3d_mesh *goat3d_create_mesh(void)
 
 GOAT3DAPI void goat3d_destroy_mesh(struct goat3d_mesh *mesh)
 {
+	if(mesh->arena) return;	/* owned by a scene */
 	g3dimpl_obj_destroy((struct object*)mesh);
-	free(mesh);
+	g3dimpl_free(mesh);
 }
 
 GOAT3DAPI int goat3d_set_mesh_name(struct goat3d_mesh *mesh, const char *name)
 {
 	char *tmpname;
-	int len = strlen(name);
 
-	if(!(tmpname = malloc(len + 1))) {
+	if(!(tmpname = g3dimpl_astrdup(mesh->arena, name))) {
 		return -1;
 	}
-	memcpy(tmpname, name, len + 1);
-	free(mesh->name);
+	if(mesh->name != mesh->defname) {
+		g3dimpl_afree(mesh->arena, mesh->name);
+	}
 	mesh->name = tmpname;
 	return 0;
 }
@@ -562,6 +716,31 @@ GOAT3DAPI struct goat3d_material *goat3d_get_mesh_mtl(struct goat3d_mesh *mesh)
 	return mesh->mtl;
 }
 
+GOAT3DAPI int goat3d_reserve_mesh(struct goat3d_mesh *mesh, int nverts, int nfaces)
+{
+	void *tmp;
+
+	if(!(tmp = dynarr_reserve(mesh->vertices, nverts))) {
+		goto err;
+	}
+	mesh->vertices = tmp;
+	if(!(tmp = dynarr_reserve(mesh->faces, nfaces))) {
+		goto err;
+	}
+	mesh->faces = tmp;
+
+	/* the rest of the vertex attribute arrays are presized when the first
+	 * element is added to each, to avoid wasting space for unused attributes
+	 */
+	mesh->reserved_verts = nverts;
+	return 0;
+
+err:
+	goat3d_logmsg(LOG_ERROR, "goat3d_reserve_mesh: failed to reserve space for %d vertices, %d faces\n",
+			nverts, nfaces);
+	return -1;
+}
+
 GOAT3DAPI int goat3d_get_mesh_attrib_count(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib)
 {
 	return dynarr_size(mesh->vertices);
@@ -656,7 +835,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 
 	case GOAT3D_MESH_ATTR_NORMAL:
 		cgm_vcons((cgm_vec3*)vec, x, y, z);
-		if(!(tmp = dynarr_push(mesh->normals, vec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->normals, vec))) {
 			goto err;
 		}
 		mesh->normals = tmp;
@@ -664,7 +843,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 
 	case GOAT3D_MESH_ATTR_TANGENT:
 		cgm_vcons((cgm_vec3*)vec, x, y, z);
-		if(!(tmp = dynarr_push(mesh->tangents, vec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->tangents, vec))) {
 			goto err;
 		}
 		mesh->tangents = tmp;
@@ -672,7 +851,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 
 	case GOAT3D_MESH_ATTR_TEXCOORD:
 		cgm_vcons((cgm_vec3*)vec, x, y, 0);
-		if(!(tmp = dynarr_push(mesh->texcoords, vec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->texcoords, vec))) {
 			goto err;
 		}
 		mesh->texcoords = tmp;
@@ -680,7 +859,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 
 	case GOAT3D_MESH_ATTR_SKIN_WEIGHT:
 		cgm_wcons((cgm_vec4*)vec, x, y, z, w);
-		if(!(tmp = dynarr_push(mesh->skin_weights, vec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->skin_weights, vec))) {
 			goto err;
 		}
 		mesh->skin_weights = tmp;
@@ -691,7 +870,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 		intvec.y = y;
 		intvec.z = z;
 		intvec.w = w;
-		if(!(tmp = dynarr_push(mesh->skin_matrices, &intvec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->skin_matrices, &intvec))) {
 			goto err;
 		}
 		mesh->skin_matrices = tmp;
@@ -699,7 +878,7 @@ GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mes
 
 	case GOAT3D_MESH_ATTR_COLOR:
 		cgm_wcons((cgm_vec4*)vec, x, y, z, w);
-		if(!(tmp = dynarr_push(mesh->colors, vec))) {
+		if(!(tmp = g3dimpl_mesh_push_vattr(mesh, mesh->colors, vec))) {
 			goto err;
 		}
 		mesh->colors = tmp;
@@ -715,12 +894,61 @@ err:
 	return -1;
 }
 
+/* the mutable getters give up any sharing with clones first, since the
+ * caller might write through the returned pointer
+ */
+#define UNSHARE(arr) \
+	do { \
+		void *tmp; \
+		if(!(tmp = dynarr_unshare(arr))) goto unshare_err; \
+		(arr) = tmp; \
+	} while(0)
+
 GOAT3DAPI void *goat3d_get_mesh_attribs(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib)
 {
 	return goat3d_get_mesh_attrib(mesh, attrib, 0);
 }
 
 GOAT3DAPI void *goat3d_get_mesh_attrib(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib, int idx)
+{
+	switch(attrib) {
+	case GOAT3D_MESH_ATTR_VERTEX:
+		UNSHARE(mesh->vertices);
+		break;
+	case GOAT3D_MESH_ATTR_NORMAL:
+		UNSHARE(mesh->normals);
+		break;
+	case GOAT3D_MESH_ATTR_TANGENT:
+		UNSHARE(mesh->tangents);
+		break;
+	case GOAT3D_MESH_ATTR_TEXCOORD:
+		UNSHARE(mesh->texcoords);
+		break;
+	case GOAT3D_MESH_ATTR_SKIN_WEIGHT:
+		UNSHARE(mesh->skin_weights);
+		break;
+	case GOAT3D_MESH_ATTR_SKIN_MATRIX:
+		UNSHARE(mesh->skin_matrices);
+		break;
+	case GOAT3D_MESH_ATTR_COLOR:
+		UNSHARE(mesh->colors);
+		break;
+	default:
+		return 0;
+	}
+	return (void*)goat3d_get_mesh_attrib_const(mesh, attrib, idx);
+
+unshare_err:
+	goat3d_logmsg(LOG_ERROR, "failed to copy shared mesh attribute array\n");
+	return 0;
+}
+
+GOAT3DAPI const void *goat3d_get_mesh_attribs_const(const struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib)
+{
+	return goat3d_get_mesh_attrib_const(mesh, attrib, 0);
+}
+
+GOAT3DAPI const void *goat3d_get_mesh_attrib_const(const struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib, int idx)
 {
 	switch(attrib) {
 	case GOAT3D_MESH_ATTR_VERTEX:
@@ -743,7 +971,6 @@ GOAT3DAPI void *goat3d_get_mesh_attrib(struct goat3d_mesh *mesh, enum goat3d_mes
 	return 0;
 }
 
-
 GOAT3DAPI int goat3d_set_mesh_faces(struct goat3d_mesh *mesh, const int *data, int num)
 {
 	void *tmp;
@@ -780,173 +1007,62 @@ GOAT3DAPI int *goat3d_get_mesh_faces(struct goat3d_mesh *mesh)
 
 GOAT3DAPI int *goat3d_get_mesh_face(struct goat3d_mesh *mesh, int idx)
 {
-	return dynarr_empty(mesh->faces) ? 0 : mesh->faces[idx].v;
-}
-
-// immedate mode state
-static enum goat3d_im_primitive im_prim;
-static struct goat3d_mesh *im_mesh;
-static cgm_vec3 im_norm, im_tang;
-static cgm_vec2 im_texcoord;
-static cgm_vec4 im_skinw, im_color = {1, 1, 1, 1};
-static int4 im_skinmat;
-static int im_use[NUM_GOAT3D_MESH_ATTRIBS];
-
-
-GOAT3DAPI void goat3d_begin(struct goat3d_mesh *mesh, enum goat3d_im_primitive prim)
-{
-	DYNARR_CLEAR(mesh->vertices);
-	DYNARR_CLEAR(mesh->normals);
-	DYNARR_CLEAR(mesh->tangents);
-	DYNARR_CLEAR(mesh->texcoords);
-	DYNARR_CLEAR(mesh->skin_weights);
-	DYNARR_CLEAR(mesh->skin_matrices);
-	DYNARR_CLEAR(mesh->colors);
-	DYNARR_CLEAR(mesh->faces);
-
-	im_mesh = mesh;
-	memset(im_use, 0, sizeof im_use);
-
-	im_prim = prim;
-}
-
-GOAT3DAPI void goat3d_end(void)
-{
-	int i, vidx, num_faces, num_quads;
-	void *tmp;
-
-	switch(im_prim) {
-	case GOAT3D_TRIANGLES:
-		{
-			num_faces = dynarr_size(im_mesh->vertices) / 3;
-			if(!(tmp = dynarr_resize(im_mesh->faces, num_faces))) {
-				return;
-			}
-			im_mesh->faces = tmp;
-
-			vidx = 0;
-			for(i=0; i<num_faces; i++) {
-				im_mesh->faces[i].v[0] = vidx++;
-				im_mesh->faces[i].v[1] = vidx++;
-				im_mesh->faces[i].v[2] = vidx++;
-			}
-		}
-		break;
-
-	case GOAT3D_QUADS:
-		{
-			num_quads = dynarr_size(im_mesh->vertices) / 4;
-			if(!(tmp = dynarr_resize(im_mesh->faces, num_quads * 2))) {
-				return;
-			}
-			im_mesh->faces = tmp;
-
-			vidx = 0;
-			for(i=0; i<num_quads; i++) {
-				im_mesh->faces[i * 2].v[0] = vidx;
-				im_mesh->faces[i * 2].v[1] = vidx + 1;
-				im_mesh->faces[i * 2].v[2] = vidx + 2;
-
-				im_mesh->faces[i * 2 + 1].v[0] = vidx;
-				im_mesh->faces[i * 2 + 1].v[1] = vidx + 2;
-				im_mesh->faces[i * 2 + 1].v[2] = vidx + 3;
-
-				vidx += 4;
-			}
-		}
-		break;
-
-	default:
-		break;
-	}
-}
-
-GOAT3DAPI void goat3d_vertex3f(float x, float y, float z)
-{
-	void *tmp;
-	cgm_vec3 v;
-
-	cgm_vcons(&v, x, y, z);
-	if(!(tmp = dynarr_push(im_mesh->vertices, &v))) {
-		return;
-	}
-	im_mesh->vertices = tmp;
-
-	if(im_use[GOAT3D_MESH_ATTR_NORMAL]) {
-		if((tmp = dynarr_push(im_mesh->normals, &im_norm))) {
-			im_mesh->normals = tmp;
-		}
-	}
-	if(im_use[GOAT3D_MESH_ATTR_TANGENT]) {
-		if((tmp = dynarr_push(im_mesh->tangents, &im_tang))) {
-			im_mesh->tangents = tmp;
-		}
-	}
-	if(im_use[GOAT3D_MESH_ATTR_TEXCOORD]) {
-		if((tmp = dynarr_push(im_mesh->texcoords, &im_texcoord))) {
-			im_mesh->texcoords = tmp;
-		}
-	}
-	if(im_use[GOAT3D_MESH_ATTR_SKIN_WEIGHT]) {
-		if((tmp = dynarr_push(im_mesh->skin_weights, &im_skinw))) {
-			im_mesh->skin_weights = tmp;
-		}
-	}
-	if(im_use[GOAT3D_MESH_ATTR_SKIN_MATRIX]) {
-		if((tmp = dynarr_push(im_mesh->skin_matrices, &im_skinmat))) {
-			im_mesh->skin_matrices = tmp;
-		}
-	}
-	if(im_use[GOAT3D_MESH_ATTR_COLOR]) {
-		if((tmp = dynarr_push(im_mesh->colors, &im_color))) {
-			im_mesh->colors = tmp;
-		}
-	}
-}
+	UNSHARE(mesh->faces);
+	return (int*)goat3d_get_mesh_face_const(mesh, idx);
 
-GOAT3DAPI void goat3d_normal3f(float x, float y, float z)
-{
-	cgm_vcons(&im_norm, x, y, z);
-	im_use[GOAT3D_MESH_ATTR_NORMAL] = 1;
+unshare_err:
+	goat3d_logmsg(LOG_ERROR, "failed to copy shared face array\n");
+	return 0;
 }
 
-GOAT3DAPI void goat3d_tangent3f(float x, float y, float z)
+GOAT3DAPI const int *goat3d_get_mesh_faces_const(const struct goat3d_mesh *mesh)
 {
-	cgm_vcons(&im_tang, x, y, z);
-	im_use[GOAT3D_MESH_ATTR_TANGENT] = 1;
+	return goat3d_get_mesh_face_const(mesh, 0);
 }
 
-GOAT3DAPI void goat3d_texcoord2f(float x, float y)
+GOAT3DAPI const int *goat3d_get_mesh_face_const(const struct goat3d_mesh *mesh, int idx)
 {
-	im_texcoord.x = x;
-	im_texcoord.y = y;
-	im_use[GOAT3D_MESH_ATTR_TEXCOORD] = 1;
+	return dynarr_empty(mesh->faces) ? 0 : mesh->faces[idx].v;
 }
 
-GOAT3DAPI void goat3d_skin_weight4f(float x, float y, float z, float w)
+GOAT3DAPI int goat3d_add_mesh_bone(struct goat3d_mesh *mesh, struct goat3d_node *bone, const float *inv_bind)
 {
-	cgm_wcons(&im_skinw, x, y, z, w);
-	im_use[GOAT3D_MESH_ATTR_SKIN_WEIGHT] = 1;
+	if(g3dimpl_mesh_add_bone(mesh, &bone->anm, inv_bind) == -1) {
+		goat3d_logmsg(LOG_ERROR, "failed to add bone %s to mesh %s\n", goat3d_get_node_name(bone), mesh->name);
+		return -1;
+	}
+	return 0;
 }
 
-GOAT3DAPI void goat3d_skin_matrix4i(int x, int y, int z, int w)
+GOAT3DAPI int goat3d_get_mesh_bone_count(const struct goat3d_mesh *mesh)
 {
-	im_skinmat.x = x;
-	im_skinmat.y = y;
-	im_skinmat.z = z;
-	im_skinmat.w = w;
-	im_use[GOAT3D_MESH_ATTR_SKIN_MATRIX] = 1;
+	return dynarr_size(mesh->bones);
 }
 
-GOAT3DAPI void goat3d_color3f(float x, float y, float z)
+GOAT3DAPI struct goat3d_node *goat3d_get_mesh_bone(const struct goat3d_mesh *mesh, int idx)
 {
-	goat3d_color4f(x, y, z, 1.0f);
+	if(idx < 0 || idx >= dynarr_size(mesh->bones)) {
+		return 0;
+	}
+	return (struct goat3d_node*)mesh->bones[idx];
 }
 
-GOAT3DAPI void goat3d_color4f(float x, float y, float z, float w)
+GOAT3DAPI int goat3d_skin_mesh(struct goat3d_mesh *mesh, long tmsec, float *out_pos, float *out_norm)
 {
-	cgm_wcons(&im_color, x, y, z, w);
-	im_use[GOAT3D_MESH_ATTR_COLOR] = 1;
+	if(dynarr_empty(mesh->bones)) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_skin_mesh: mesh %s has no bones\n", mesh->name);
+		return -1;
+	}
+	if(dynarr_size(mesh->skin_weights) != dynarr_size(mesh->vertices) ||
+			dynarr_size(mesh->skin_matrices) != dynarr_size(mesh->vertices)) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_skin_mesh: mesh %s is missing skin weights or matrices\n", mesh->name);
+		return -1;
+	}
+	if(g3dimpl_skin_mesh(mesh, tmsec, out_pos, out_norm) == -1) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_skin_mesh: failed to allocate bone matrix palette\n");
+		return -1;
+	}
+	return 0;
 }
 
 GOAT3DAPI void goat3d_get_mesh_bounds(const struct goat3d_mesh *mesh, float *bmin, float *bmax)
@@ -1000,11 +1116,11 @@ GOAT3DAPI struct goat3d_light *goat3d_create_light(void)
 {
 	struct goat3d_light *lt;
 
-	if(!(lt = malloc(sizeof *lt))) {
+	if(!(lt = g3dimpl_malloc(sizeof *lt))) {
 		return 0;
 	}
-	if(g3dimpl_obj_init((struct object*)lt, OBJTYPE_LIGHT) == -1) {
-		free(lt);
+	if(g3dimpl_obj_init((struct object*)lt, OBJTYPE_LIGHT, 0) == -1) {
+		g3dimpl_free(lt);
 		return 0;
 	}
 	return lt;
@@ -1012,8 +1128,9 @@ GOAT3DAPI struct goat3d_light *goat3d_create_light(void)
 
 GOAT3DAPI void goat3d_destroy_light(struct goat3d_light *lt)
 {
+	if(lt->arena) return;	/* owned by a scene */
 	g3dimpl_obj_destroy((struct object*)lt);
-	free(lt);
+	g3dimpl_free(lt);
 }
 
 
@@ -1053,11 +1170,11 @@ GOAT3DAPI struct goat3d_camera *goat3d_create_camera(void)
 {
 	struct goat3d_camera *cam;
 
-	if(!(cam = malloc(sizeof *cam))) {
+	if(!(cam = g3dimpl_malloc(sizeof *cam))) {
 		return 0;
 	}
-	if(g3dimpl_obj_init((struct object*)cam, OBJTYPE_CAMERA) == -1) {
-		free(cam);
+	if(g3dimpl_obj_init((struct object*)cam, OBJTYPE_CAMERA, 0) == -1) {
+		g3dimpl_free(cam);
 		return 0;
 	}
 	return cam;
@@ -1065,8 +1182,9 @@ GOAT3DAPI struct goat3d_camera *goat3d_create_camera(void)
 
 GOAT3DAPI void goat3d_destroy_camera(struct goat3d_camera *cam)
 {
+	if(cam->arena) return;	/* owned by a scene */
 	g3dimpl_obj_destroy((struct object*)cam);
-	free(cam);
+	g3dimpl_free(cam);
 }
 
 
@@ -1107,16 +1225,17 @@ GOAT3DAPI struct goat3d_node *goat3d_create_node(void)
 {
 	struct goat3d_node *node;
 
-	if(!(node = malloc(sizeof *node))) {
+	if(!(node = g3dimpl_malloc(sizeof *node))) {
 		return 0;
 	}
 	if(anm_init_node(&node->anm) == -1) {
-		free(node);
+		g3dimpl_free(node);
 		return 0;
 	}
 	node->type = GOAT3D_NODE_NULL;
 	node->obj = 0;
 	node->child_count = 0;
+	memset(node->key_cursor, 0, sizeof node->key_cursor);
 
 	return node;
 }
@@ -1124,7 +1243,7 @@ GOAT3DAPI struct goat3d_node *goat3d_create_node(void)
 GOAT3DAPI void goat3d_destroy_node(struct goat3d_node *node)
 {
 	anm_destroy_node(&node->anm);
-	free(node);
+	g3dimpl_free(node);
 }
 
 GOAT3DAPI int goat3d_set_node_name(struct goat3d_node *node, const char *name)
@@ -1167,7 +1286,7 @@ GOAT3DAPI int goat3d_get_node_child_count(const struct goat3d_node *node)
 GOAT3DAPI struct goat3d_node *goat3d_get_node_child(const struct goat3d_node *node, int idx)
 {
 	struct anm_node *c = node->anm.child;
-	while(c && idx > 0) {
+	while(c && idx-- > 0) {
 		c = c->next;
 	}
 	return (struct goat3d_node*)c;
@@ -1239,15 +1358,12 @@ GOAT3DAPI const char *goat3d_get_anim_name(struct goat3d_node *node)
 	return anm_get_active_animation_name(&node->anm);
 }
 
-enum { POSITION_TRACK, ROTATION_TRACK, SCALING_TRACK };
-static const int track_type_base[] = {ANM_TRACK_POS_X, ANM_TRACK_ROT_X, ANM_TRACK_SCL_X};
-static const int track_type_nelem[] = {3, 4, 4};
 
 static int get_key_count(struct anm_node *node, int trackid)
 {
 	struct anm_animation *anim = anm_get_active_animation(node, 0);
 	if(anim) {
-		return anim->tracks[track_type_base[trackid]].count;
+		return anim->tracks[g3dimpl_track_base[trackid]].count;
 	}
 	return 0;
 }
@@ -1255,16 +1371,16 @@ static int get_key_count(struct anm_node *node, int trackid)
 static long get_key_time(struct anm_node *node, int trackid, int idx)
 {
 	struct anm_animation *anim = anm_get_active_animation(node, 0);
-	struct anm_keyframe *key = anm_get_keyframe(anim->tracks + track_type_base[trackid], idx);
+	struct anm_keyframe *key = anm_get_keyframe(anim->tracks + g3dimpl_track_base[trackid], idx);
 	return ANM_TM2MSEC(key->time);
 }
 
 static int get_key_value(struct anm_node *node, int trackid, int idx, float *val)
 {
 	struct anm_animation *anim = anm_get_active_animation(node, 0);
-	int i, nelem = track_type_nelem[trackid];
+	int i, nelem = g3dimpl_track_nelem[trackid];
 	for(i=0; i<nelem; i++) {
-		struct anm_keyframe *key = anm_get_keyframe(anim->tracks + track_type_base[trackid] + i, idx);
+		struct anm_keyframe *key = anm_get_keyframe(anim->tracks + g3dimpl_track_base[trackid] + i, idx);
 		val[i] = key->val;
 	}
 	return nelem;
@@ -1289,7 +1405,7 @@ GOAT3DAPI long goat3d_get_anim_timeline(struct goat3d_node *root, long *tstart,
 	c = root->anm.child;
 	while(c) {
 		long cstart, cend;
-		if(goat3d_get_anim_timeline((struct goat3d_node*)c, &cstart, &cend)) {
+		if(goat3d_get_anim_timeline((struct goat3d_node*)c, &cstart, &cend) >= 0) {
 			if(cstart < node_start) node_start = cstart;
 			if(cend > node_end) node_end = cend;
 		}
@@ -1386,7 +1502,7 @@ GOAT3DAPI void goat3d_set_node_pivot(struct goat3d_node *node, float px, float p
 GOAT3DAPI void goat3d_get_node_position(const struct goat3d_node *node, float *xptr, float *yptr, float *zptr, long tmsec)
 {
 	float pos[3];
-	anm_get_node_position((struct anm_node*)&node->anm, pos, ANM_MSEC2TM(tmsec));
+	g3dimpl_node_position((struct goat3d_node*)node, pos, ANM_MSEC2TM(tmsec));
 	*xptr = pos[0];
 	*yptr = pos[1];
 	*zptr = pos[2];
@@ -1395,7 +1511,7 @@ GOAT3DAPI void goat3d_get_node_position(const struct goat3d_node *node, float *x
 GOAT3DAPI void goat3d_get_node_rotation(const struct goat3d_node *node, float *xptr, float *yptr, float *zptr, float *wptr, long tmsec)
 {
 	float rot[4];
-	anm_get_node_rotation((struct anm_node*)&node->anm, rot, ANM_MSEC2TM(tmsec));
+	g3dimpl_node_rotation((struct goat3d_node*)node, rot, ANM_MSEC2TM(tmsec));
 	*xptr = rot[0];
 	*yptr = rot[1];
 	*zptr = rot[2];
@@ -1405,7 +1521,7 @@ GOAT3DAPI void goat3d_get_node_rotation(const struct goat3d_node *node, float *x
 GOAT3DAPI void goat3d_get_node_scaling(const struct goat3d_node *node, float *xptr, float *yptr, float *zptr, long tmsec)
 {
 	float scale[3];
-	anm_get_node_scaling((struct anm_node*)&node->anm, scale, ANM_MSEC2TM(tmsec));
+	g3dimpl_node_scaling((struct goat3d_node*)node, scale, ANM_MSEC2TM(tmsec));
 	*xptr = scale[0];
 	*yptr = scale[1];
 	*zptr = scale[2];
@@ -1419,7 +1535,20 @@ GOAT3DAPI void goat3d_get_node_pivot(const struct goat3d_node *node, float *xptr
 
 GOAT3DAPI void goat3d_get_node_matrix(const struct goat3d_node *node, float *matrix, long tmsec)
 {
-	anm_get_node_matrix((struct anm_node*)&node->anm, matrix, ANM_MSEC2TM(tmsec));
+	float pivot[3];
+	cgm_vec3 pos, scale;
+	cgm_quat rot;
+	anm_time_t tm = ANM_MSEC2TM(tmsec);
+	struct goat3d_node *n = (struct goat3d_node*)node;
+
+	/* evaluated from scratch without touching any libanim caches, only the
+	 * key cursors are updated, which is safe to do concurrently
+	 */
+	g3dimpl_node_position(n, &pos.x, tm);
+	g3dimpl_node_rotation(n, &rot.x, tm);
+	g3dimpl_node_scaling(n, &scale.x, tm);
+	anm_get_pivot(&n->anm, pivot, pivot + 1, pivot + 2);
+	g3dimpl_trs_matrix(matrix, &pos, &rot, &scale, pivot);
 }
 
 GOAT3DAPI void goat3d_get_node_bounds(const struct goat3d_node *node, float *bmin, float *bmax)
@@ -1435,6 +1564,62 @@ GOAT3DAPI void goat3d_get_node_bounds(const struct goat3d_node *node, float *bmi
 	bmax[2] = box.bmax.z;
 }
 
+/* baked animations */
+GOAT3DAPI struct goat3d_baked_anim *goat3d_bake_anim(struct goat3d *g, int anim_idx, float rate_hz)
+{
+	struct goat3d_baked_anim *ba;
+
+	if(!(ba = g3dimpl_malloc(sizeof *ba))) {
+		return 0;
+	}
+	if(g3dimpl_bake_anim(ba, g->nodes, dynarr_size(g->nodes), anim_idx, rate_hz) == -1) {
+		goat3d_logmsg(LOG_ERROR, "failed to bake animation %d at %g hz\n", anim_idx, rate_hz);
+		g3dimpl_free(ba);
+		return 0;
+	}
+	return ba;
+}
+
+GOAT3DAPI void goat3d_free_baked_anim(struct goat3d_baked_anim *ba)
+{
+	if(ba) {
+		g3dimpl_free(ba->frames);
+		g3dimpl_free(ba->times);
+		g3dimpl_free(ba);
+	}
+}
+
+GOAT3DAPI int goat3d_get_baked_frame_count(const struct goat3d_baked_anim *ba)
+{
+	return ba->num_frames;
+}
+
+GOAT3DAPI int goat3d_get_baked_node_count(const struct goat3d_baked_anim *ba)
+{
+	return ba->num_nodes;
+}
+
+GOAT3DAPI long goat3d_get_baked_timeline(const struct goat3d_baked_anim *ba, long *tstart, long *tend)
+{
+	*tstart = ba->tstart;
+	*tend = ba->tend;
+	return ba->tend - ba->tstart;
+}
+
+GOAT3DAPI void goat3d_sample_baked(const struct goat3d_baked_anim *ba, long tmsec, float *out)
+{
+	g3dimpl_sample_baked(ba, out, tmsec);
+}
+
+GOAT3DAPI int goat3d_eval_anim_jobs(const struct goat3d *g, struct goat3d_anim_job *jobs, int num_jobs)
+{
+	if(g3dimpl_eval_anim_jobs(g->nodes, dynarr_size(g->nodes), jobs, num_jobs) == -1) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_eval_anim_jobs: failed to allocate node hierarchy\n");
+		return -1;
+	}
+	return 0;
+}
+
 
 static long read_file(void *buf, size_t bytes, void *uptr)
 {
@@ -1454,6 +1639,33 @@ static long seek_file(long offs, int whence, void *uptr)
 	return ftell((FILE*)uptr);
 }
 
+static long read_mem(void *buf, size_t bytes, void *uptr)
+{
+	return -1;
+}
+
+static long write_mem(const void *buf, size_t bytes, void *uptr)
+{
+	struct memio *mem = uptr;
+
+	if(mem->size + bytes > mem->max) {
+		size_t newmax = mem->max ? mem->max : 4096;
+		char *tmp;
+
+		while(newmax < mem->size + bytes) newmax *= 2;
+		if(!(tmp = g3dimpl_realloc(mem->wbuf, newmax))) {
+			goat3d_logmsg(LOG_ERROR, "goat3d_save_mem: failed to grow buffer to %lu bytes\n",
+					(unsigned long)newmax);
+			return -1;
+		}
+		mem->wbuf = tmp;
+		mem->max = newmax;
+	}
+	memcpy(mem->wbuf + mem->size, buf, bytes);
+	mem->size += bytes;
+	return (long)bytes;
+}
+
 static char *clean_filename(char *str)
 {
 	char *last_slash, *ptr;
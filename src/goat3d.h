@@ -37,6 +37,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define GOAT3D_MAT_ATTR_IOR				"ior"
 #define GOAT3D_MAT_ATTR_ALPHA			"alpha"
 
+/* predefined atoms of the standard material attribute names, see goat3d_atom */
+enum {
+	GOAT3D_ATOM_NONE,			/* the empty string */
+	GOAT3D_ATOM_DIFFUSE,
+	GOAT3D_ATOM_SPECULAR,
+	GOAT3D_ATOM_SHININESS,
+	GOAT3D_ATOM_NORMAL,
+	GOAT3D_ATOM_BUMP,
+	GOAT3D_ATOM_REFLECTION,
+	GOAT3D_ATOM_TRANSMISSION,
+	GOAT3D_ATOM_IOR,
+	GOAT3D_ATOM_ALPHA,
+
+	NUM_GOAT3D_PREDEF_ATOMS
+};
+
 enum goat3d_mesh_attrib {
 	GOAT3D_MESH_ATTR_VERTEX,
 	GOAT3D_MESH_ATTR_NORMAL,
@@ -62,10 +78,61 @@ enum goat3d_im_primitive {
 	GOAT3D_QUADS
 };
 
+/* vertex arrays for batched immediate mode submission, see goat3d_im_vertex_arrays */
+struct goat3d_im_arrays {
+	const float *vertices;		/* 3 floats per vertex */
+	const float *normals;		/* 3 floats per vertex */
+	const float *tangents;		/* 3 floats per vertex */
+	const float *texcoords;		/* 2 floats per vertex */
+	const float *skin_weights;	/* 4 floats per vertex */
+	const int *skin_matrices;	/* 4 ints per vertex */
+	const float *colors;		/* 4 floats per vertex */
+};
+
+
+/* components of baked animation samples, see goat3d_sample_baked */
+enum goat3d_baked_comp {
+	GOAT3D_BAKED_POS_X,
+	GOAT3D_BAKED_POS_Y,
+	GOAT3D_BAKED_POS_Z,
+	GOAT3D_BAKED_ROT_X,
+	GOAT3D_BAKED_ROT_Y,
+	GOAT3D_BAKED_ROT_Z,
+	GOAT3D_BAKED_ROT_W,
+	GOAT3D_BAKED_SCL_X,
+	GOAT3D_BAKED_SCL_Y,
+	GOAT3D_BAKED_SCL_Z,
+
+	NUM_GOAT3D_BAKED_COMPS
+};
+
+/* memory usage categories, see goat3d_get_memory_stats */
+enum goat3d_mem_category {
+	/* vertex attribute arrays, in goat3d_mesh_attrib order */
+	GOAT3D_MEM_VERTICES,
+	GOAT3D_MEM_NORMALS,
+	GOAT3D_MEM_TANGENTS,
+	GOAT3D_MEM_TEXCOORDS,
+	GOAT3D_MEM_SKIN_WEIGHTS,
+	GOAT3D_MEM_SKIN_MATRICES,
+	GOAT3D_MEM_COLORS,
+
+	GOAT3D_MEM_FACES,
+	GOAT3D_MEM_BONES,		/* bone lists and inverse bind matrices */
+	GOAT3D_MEM_NAMES,		/* object, material, node, and texture map names */
+	GOAT3D_MEM_MATERIALS,	/* materials and their attributes */
+	GOAT3D_MEM_OBJECTS,		/* mesh, light, and camera structures */
+	GOAT3D_MEM_NODES,
+	GOAT3D_MEM_ANIM_KEYS,	/* animation tracks and keyframes */
+	GOAT3D_MEM_SCENE,		/* scene structure and object lists */
+
+	NUM_GOAT3D_MEM_CATEGORIES
+};
 
 enum goat3d_option {
 	GOAT3D_OPT_SAVEXML,		/* save in XML format (dropped) */
 	GOAT3D_OPT_SAVETEXT,	/* save in text format */
+	GOAT3D_OPT_ANIMCOMPRESS,	/* save animations with lossy keyframe compression */
 
 	NUM_GOAT3D_OPTIONS
 };
@@ -76,7 +143,61 @@ struct goat3d_mesh;
 struct goat3d_light;
 struct goat3d_camera;
 struct goat3d_node;
+struct goat3d_baked_anim;
+struct goat3d_im_context;
+struct goat3d_load;
+
+/* goat3d_load_async flags */
+enum {
+	GOAT3D_LOAD_ANIM	= 1		/* load an animation file into an already loaded scene */
+};
+
+/* asynchronous load progress, see goat3d_load_poll */
+struct goat3d_load_progress {
+	long bytes, total_bytes;	/* bytes read so far, and file size */
+	int objects;				/* materials, meshes, or animation tracks loaded so far */
+};
+
+typedef void (*goat3d_load_done_func)(struct goat3d *g, int result, void *cls);
+
+/* host application parallel loop, see goat3d_set_scheduler */
+typedef void (*goat3d_task_func)(int idx, void *cls);
+typedef void (*goat3d_parallel_for_func)(int count, goat3d_task_func task, void *task_cls, void *cls);
+
+/* batch animation evaluation job, see goat3d_eval_anim_jobs */
+struct goat3d_anim_job {
+	long tmsec;			/* time to evaluate at */
+	int anim[2];		/* animations to blend, anim[1] is -1 for just anim[0] */
+	float mix;			/* blend factor, 0 means only anim[0], 1 means only anim[1] */
+	float *matrices;	/* output: 16 floats per node, in goat3d_get_node order */
+};
 
+struct goat3d_mem_usage {
+	size_t used;		/* bytes holding actual data */
+	size_t reserved;	/* bytes allocated, including unused capacity */
+};
+
+/* mesh data shared with clones (see goat3d_clone) is split evenly between
+ * its owners, so the stats of scenes sharing data add up to what's allocated
+ */
+struct goat3d_memory_stats {
+	struct goat3d_mem_usage cat[NUM_GOAT3D_MEM_CATEGORIES];
+	struct goat3d_mem_usage total;	/* sum of all categories */
+	/* data loaded into a scene lives in the scene arena, and is already counted
+	 * in the categories above. This reports how much of the arena blocks it
+	 * uses, the rest is unused block space, not included in total.
+	 */
+	struct goat3d_mem_usage arena;
+};
+
+/* custom memory allocation functions, see goat3d_set_allocator */
+typedef void *(*goat3d_alloc_func)(size_t size, void *cls);
+typedef void *(*goat3d_realloc_func)(void *ptr, size_t size, void *cls);
+typedef void (*goat3d_free_func)(void *ptr, void *cls);
+
+/* seek is optional (may be null): saving never seeks, so it works on pipes and
+ * sockets, and loading only uses it to hand back unused read-ahead data.
+ */
 struct goat3d_io {
 	void *cls;	/* closure data */
 
@@ -89,10 +210,72 @@ struct goat3d_io {
 extern "C" {
 #endif
 
+/* memory allocation
+ * goat3d_set_allocator replaces the functions used for all memory allocated by
+ * goat3d itself (memory allocated internally by libanim and treestore is not
+ * affected). It must be called before any other goat3d call, or after all goat3d
+ * objects have been freed. Passing null functions restores malloc/realloc/free.
+ *
+ * goat3d_set_scene_allocator sets the allocator used for the scene data loaded
+ * into a scene from then on (see goat3d_load*), which is otherwise allocated
+ * with the global allocator. Passing null functions restores the default.
+ */
+GOAT3DAPI void goat3d_set_allocator(goat3d_alloc_func alloc_func, goat3d_realloc_func realloc_func,
+		goat3d_free_func free_func, void *cls);
+GOAT3DAPI void goat3d_set_scene_allocator(struct goat3d *g, goat3d_alloc_func alloc_func,
+		goat3d_realloc_func realloc_func, goat3d_free_func free_func, void *cls);
+
+/* atoms are interned strings, represented by small integers, which are the same
+ * for equal strings for the lifetime of the program. goat3d_atom returns the atom
+ * for a string, interning it if necessary (-1 on failure), and goat3d_atom_name
+ * returns the string of an atom. The standard material attribute names have
+ * predefined atoms (GOAT3D_ATOM_*). Both functions are thread-safe.
+ */
+GOAT3DAPI int goat3d_atom(const char *str);
+GOAT3DAPI const char *goat3d_atom_name(int atom);
+
+/* thread-safety: the query functions (goat3d_get_*, and other functions which
+ * don't modify anything, like goat3d_skin_mesh or goat3d_eval_anim_jobs) can
+ * be called concurrently from any number of threads on the same scene, as long
+ * as no thread modifies the scene, or any of its objects, at the same time.
+ * Data derived on demand by queries (scene bounds, key lookup cursors) is
+ * published with atomic operations, without global locks. Functions which
+ * modify a scene or object need exclusive access to it, and so do the mutable
+ * mesh data getters (goat3d_get_mesh_attribs/faces), which might copy shared
+ * arrays; use their _const variants for concurrent reads.
+ */
+
+/* parallel operations (like goat3d_eval_anim_jobs and goat3d_skin_mesh) run
+ * on a thread pool shared by the whole library. goat3d_set_threads sets the
+ * number of threads taking part in parallel operations, including the calling
+ * thread; 1 disables the pool, and 0 means one per processor (the default).
+ * It waits for any parallel operation in progress to finish, and returns the
+ * number of worker threads started, or -1 on failure.
+ *
+ * Alternatively goat3d_set_scheduler hands parallel operations to the host
+ * application scheduler instead: func must call task(i, task_cls) for every
+ * i in [0, count), in any order and from any threads, and return when they're
+ * all done. The pool threads are stopped while a scheduler is set, pass a null
+ * func to go back to the pool. Set the scheduler before starting any parallel
+ * operation.
+ */
+GOAT3DAPI int goat3d_set_threads(int num_threads);
+GOAT3DAPI void goat3d_set_scheduler(goat3d_parallel_for_func func, void *cls);
+
 /* construction/destruction */
 GOAT3DAPI struct goat3d *goat3d_create(void);
 GOAT3DAPI void goat3d_free(struct goat3d *g);
 
+/* goat3d_clone creates an independent copy of the scene. Materials, lights,
+ * cameras, and nodes with their hierarchy and animations are copied, while
+ * mesh vertex attribute and face arrays are shared with the source scene, and
+ * only copied when either scene modifies them through the goat3d mesh
+ * functions. The mutable mesh data getters (goat3d_get_mesh_attribs, etc)
+ * make a private copy of the array first, while the _const variants return
+ * the shared data. Returns null on failure.
+ */
+GOAT3DAPI struct goat3d *goat3d_clone(const struct goat3d *g);
+
 GOAT3DAPI void goat3d_setopt(struct goat3d *g, enum goat3d_option opt, int val);
 GOAT3DAPI int goat3d_getopt(const struct goat3d *g, enum goat3d_option opt);
 
@@ -103,9 +286,23 @@ GOAT3DAPI int goat3d_save(const struct goat3d *g, const char *fname);
 GOAT3DAPI int goat3d_load_file(struct goat3d *g, FILE *fp);
 GOAT3DAPI int goat3d_save_file(const struct goat3d *g, FILE *fp);
 
+/* binary scenes are streamed from io through a block sized buffer, and their
+ * checksum is checked before anything is added to the scene. Text scenes are
+ * read into memory whole first, for the text scene parser, so loading them
+ * needs memory for the whole file on top of the scene, and consumes io to the
+ * end of the stream.
+ */
 GOAT3DAPI int goat3d_load_io(struct goat3d *g, struct goat3d_io *io);
 GOAT3DAPI int goat3d_save_io(const struct goat3d *g, struct goat3d_io *io);
 
+/* load/save a scene from/to a memory buffer. goat3d_save_mem allocates the
+ * buffer and returns it in bufret and its size in sizeret. It's allocated with
+ * the global allocator (see goat3d_set_allocator), so it must be freed with
+ * free, or the free function passed to goat3d_set_allocator.
+ */
+GOAT3DAPI int goat3d_load_mem(struct goat3d *g, const void *buf, size_t size);
+GOAT3DAPI int goat3d_save_mem(const struct goat3d *g, void **bufret, size_t *sizeret);
+
 /* load/save animation files (g must already be loaded to load animations) */
 GOAT3DAPI int goat3d_load_anim(struct goat3d *g, const char *fname);
 GOAT3DAPI int goat3d_save_anim(const struct goat3d *g, const char *fname);
@@ -116,6 +313,88 @@ GOAT3DAPI int goat3d_save_anim_file(const struct goat3d *g, FILE *fp);
 GOAT3DAPI int goat3d_load_anim_io(struct goat3d *g, struct goat3d_io *io);
 GOAT3DAPI int goat3d_save_anim_io(const struct goat3d *g, struct goat3d_io *io);
 
+/* all loading and saving goes through an I/O buffer, so that the goat3d_io
+ * callbacks are called with large blocks, instead of once for every small
+ * piece of data the parser asks for or the writer produces. The block size
+ * defaults to 1mb, set it to 0 to call the io callbacks directly. Text scenes
+ * are read whole, until the end of the stream, and parsed from memory, while
+ * binary scenes are streamed (see goat3d_load_io). When loading animations, or
+ * binary scenes without a checksum, from an io with a seek callback, the
+ * stream is left right after the data consumed by the parser, even though it
+ * read ahead.
+ */
+GOAT3DAPI void goat3d_set_io_block_size(size_t sz);
+GOAT3DAPI size_t goat3d_get_io_block_size(void);
+
+/* checks the integrity of a file without decoding it, by streaming it through
+ * the CRC32C checksum. Binary scene saves end with a checksum of the whole
+ * file. Returns 0 if the checksum matches, 1 if there's nothing to verify
+ * (text files, and binary files written without a checksum), and -1 if the
+ * file is corrupted or can't be read. Loading a binary scene also checks its
+ * checksum.
+ */
+GOAT3DAPI int goat3d_verify(const char *fname);
+GOAT3DAPI int goat3d_verify_io(struct goat3d_io *io);
+
+/* scene summary, stored in a small fixed-layout block at the start of binary
+ * scene files, so that it can be read with goat3d_peek without loading the
+ * scene. The bounds are the scene bounds (see goat3d_get_bounds), or the
+ * union of the mesh bounds if the scene has no nodes. The animation range is
+ * valid only if anim is non-zero. The hash is a CRC32C of all mesh vertex and
+ * face data, and doesn't depend on the file format.
+ */
+struct goat3d_summary {
+	int num_mtls, num_meshes, num_lights, num_cameras, num_nodes;
+	size_t num_verts, num_faces;
+	float bmin[3], bmax[3];
+	int anim;
+	long tstart, tend;
+	unsigned int hash;
+};
+
+/* computes the summary of a scene in memory */
+GOAT3DAPI void goat3d_get_summary(const struct goat3d *g, struct goat3d_summary *sum);
+/* reads the summary block of a scene file, without reading the rest of it.
+ * Returns 0 on success, 1 if the file doesn't have a summary (text files, and
+ * files written before summaries were added), and -1 on errors. On files
+ * without a summary, fall back to goat3d_load and goat3d_get_summary.
+ */
+GOAT3DAPI int goat3d_peek(const char *fname, struct goat3d_summary *sum);
+GOAT3DAPI int goat3d_peek_file(FILE *fp, struct goat3d_summary *sum);
+
+/* asynchronous loading: goat3d_load_async starts loading a scene (or an
+ * animation with the GOAT3D_LOAD_ANIM flag) in a background thread, and
+ * returns immediately. The scene must not be accessed until loading is done.
+ * goat3d_load_poll returns 1 while loading is in progress, and the result of
+ * the load (0 or -1) once it's done, optionally filling in the progress so far.
+ * goat3d_load_wait waits for the load to finish, releases the handle, and
+ * returns the result; it must be called exactly once for every handle, even
+ * after goat3d_load_cancel, which only asks the loader to stop early.
+ * If set, done_func is called from the loading thread when loading is done;
+ * it must not call goat3d_load_wait, which would join the thread it runs on.
+ * A failed or cancelled scene load leaves the scene empty.
+ */
+GOAT3DAPI struct goat3d_load *goat3d_load_async(struct goat3d *g, const char *fname, unsigned int flags,
+		goat3d_load_done_func done_func, void *cls);
+GOAT3DAPI int goat3d_load_poll(struct goat3d_load *ld, struct goat3d_load_progress *prog);
+GOAT3DAPI int goat3d_load_wait(struct goat3d_load *ld);
+GOAT3DAPI void goat3d_load_cancel(struct goat3d_load *ld);
+
+/* process-wide cache of loaded scenes. goat3d_load_cached returns a shared
+ * scene, loading it only if the file isn't already in the cache, or if it
+ * changed since it was loaded. Cached scenes must not be modified; use
+ * goat3d_clone to get a private copy, which shares the mesh data with the
+ * cached scene. Every successful goat3d_load_cached call must be matched by a
+ * goat3d_release_cached call. Scenes no longer in use are kept around as long
+ * as the cache fits in its budget (128mb by default), and evicted in least
+ * recently used order. All cache functions are thread-safe.
+ */
+GOAT3DAPI const struct goat3d *goat3d_load_cached(const char *fname);
+GOAT3DAPI void goat3d_release_cached(const struct goat3d *g);
+GOAT3DAPI void goat3d_set_cache_budget(size_t bytes);
+/* frees every cached scene not currently in use */
+GOAT3DAPI void goat3d_flush_cache(void);
+
 /* misc scene properties */
 GOAT3DAPI int goat3d_set_name(struct goat3d *g, const char *name);
 GOAT3DAPI const char *goat3d_get_name(const struct goat3d *g);
@@ -126,6 +405,12 @@ GOAT3DAPI const float *goat3d_get_ambient(const struct goat3d *g);
 
 GOAT3DAPI int goat3d_get_bounds(const struct goat3d *g, float *bmin, float *bmax);
 
+/* memory usage of the scene, and everything in it, by category. Memory owned
+ * by the atom table (see goat3d_atom) is shared by all scenes and not included.
+ * Mesh data shared between clones (see goat3d_clone) is counted in each scene.
+ */
+GOAT3DAPI void goat3d_get_memory_stats(const struct goat3d *g, struct goat3d_memory_stats *stats);
+
 /* materials */
 GOAT3DAPI int goat3d_add_mtl(struct goat3d *g, struct goat3d_material *mtl);
 GOAT3DAPI int goat3d_get_mtl_count(struct goat3d *g);
@@ -147,6 +432,13 @@ GOAT3DAPI const float *goat3d_get_mtl_attrib(struct goat3d_material *mtl, const
 GOAT3DAPI int goat3d_set_mtl_attrib_map(struct goat3d_material *mtl, const char *attrib, const char *mapname);
 GOAT3DAPI const char *goat3d_get_mtl_attrib_map(struct goat3d_material *mtl, const char *attrib);
 
+/* material attribute access by atom (see goat3d_atom), which avoids string
+ * comparisons, and is constant time for the predefined attribute atoms.
+ */
+GOAT3DAPI int goat3d_set_mtl_attrib_atom(struct goat3d_material *mtl, int atom, const float *val);
+GOAT3DAPI const float *goat3d_get_mtl_attrib_atom(struct goat3d_material *mtl, int atom);
+GOAT3DAPI const char *goat3d_get_mtl_attrib_map_atom(struct goat3d_material *mtl, int atom);
+
 /* meshes */
 GOAT3DAPI int goat3d_add_mesh(struct goat3d *g, struct goat3d_mesh *mesh);
 GOAT3DAPI int goat3d_get_mesh_count(struct goat3d *g);
@@ -162,6 +454,12 @@ GOAT3DAPI const char *goat3d_get_mesh_name(const struct goat3d_mesh *mesh);
 GOAT3DAPI void goat3d_set_mesh_mtl(struct goat3d_mesh *mesh, struct goat3d_material *mtl);
 GOAT3DAPI struct goat3d_material *goat3d_get_mesh_mtl(struct goat3d_mesh *mesh);
 
+/* preallocates space for nverts vertices and nfaces faces, to avoid repeated
+ * reallocations when adding mesh data one element at a time. Every vertex
+ * attribute array is presized when its first element is added.
+ */
+GOAT3DAPI int goat3d_reserve_mesh(struct goat3d_mesh *mesh, int nverts, int nfaces);
+
 GOAT3DAPI int goat3d_get_mesh_attrib_count(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib);
 GOAT3DAPI int goat3d_get_mesh_face_count(struct goat3d_mesh *mesh);
 
@@ -185,23 +483,34 @@ GOAT3DAPI int goat3d_add_mesh_attrib3f(struct goat3d_mesh *mesh, enum goat3d_mes
 		float x, float y, float z);
 GOAT3DAPI int goat3d_add_mesh_attrib4f(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib,
 		float x, float y, float z, float w);
-/* returns a pointer to the beginning of the requested mesh attribute array */
+/* returns a pointer to the beginning of the requested mesh attribute array.
+ * If the array is shared with a clone (see goat3d_clone), it's copied first,
+ * so that it can be modified in place. Use the _const variants for reading,
+ * they never copy.
+ */
 GOAT3DAPI void *goat3d_get_mesh_attribs(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib);
 /* returns a pointer to the requested mesh attribute */
 GOAT3DAPI void *goat3d_get_mesh_attrib(struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib, int idx);
+GOAT3DAPI const void *goat3d_get_mesh_attribs_const(const struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib);
+GOAT3DAPI const void *goat3d_get_mesh_attrib_const(const struct goat3d_mesh *mesh, enum goat3d_mesh_attrib attrib, int idx);
 
 /* sets all the faces in one go. data is an array of 3 int vertex indices per face */
 GOAT3DAPI int goat3d_set_mesh_faces(struct goat3d_mesh *mesh, const int *data, int fnum);
 GOAT3DAPI int goat3d_add_mesh_face(struct goat3d_mesh *mesh, int a, int b, int c);
-/* returns a pointer to the beginning of the face index array */
+/* returns a pointer to the beginning of the face index array, copied first
+ * if it's shared like goat3d_get_mesh_attribs
+ */
 GOAT3DAPI int *goat3d_get_mesh_faces(struct goat3d_mesh *mesh);
 /* returns a pointer to a face index */
 GOAT3DAPI int *goat3d_get_mesh_face(struct goat3d_mesh *mesh, int idx);
+GOAT3DAPI const int *goat3d_get_mesh_faces_const(const struct goat3d_mesh *mesh);
+GOAT3DAPI const int *goat3d_get_mesh_face_const(const struct goat3d_mesh *mesh, int idx);
 
 /* immediate mode OpenGL-like interface for setting mesh data
  *  NOTE: using this interface will result in no vertex sharing between faces
- * NOTE2: the immedate mode interface is not thread-safe, either use locks, or don't
- *        use it at all in multithreaded situations.
+ * NOTE2: the global immedate mode interface is not thread-safe. For building
+ *        meshes from multiple threads, use a separate context per thread with
+ *        the goat3d_im_* functions below.
  */
 GOAT3DAPI void goat3d_begin(struct goat3d_mesh *mesh, enum goat3d_im_primitive prim);
 GOAT3DAPI void goat3d_end(void);
@@ -214,8 +523,54 @@ GOAT3DAPI void goat3d_skin_matrix4i(int x, int y, int z, int w);
 GOAT3DAPI void goat3d_color3f(float x, float y, float z);
 GOAT3DAPI void goat3d_color4f(float x, float y, float z, float w);
 
+/* immediate mode contexts hold the immediate mode state, so that meshes can be
+ * built concurrently, each with its own context. The goat3d_im_* functions
+ * work like their global counterparts above.
+ */
+GOAT3DAPI struct goat3d_im_context *goat3d_create_im_context(void);
+GOAT3DAPI void goat3d_free_im_context(struct goat3d_im_context *ctx);
+
+GOAT3DAPI void goat3d_im_begin(struct goat3d_im_context *ctx, struct goat3d_mesh *mesh,
+		enum goat3d_im_primitive prim);
+GOAT3DAPI int goat3d_im_end(struct goat3d_im_context *ctx);
+/* hint that about nverts vertices will be submitted (call after begin) */
+GOAT3DAPI int goat3d_im_reserve(struct goat3d_im_context *ctx, int nverts);
+GOAT3DAPI void goat3d_im_vertex3f(struct goat3d_im_context *ctx, float x, float y, float z);
+GOAT3DAPI void goat3d_im_normal3f(struct goat3d_im_context *ctx, float x, float y, float z);
+GOAT3DAPI void goat3d_im_tangent3f(struct goat3d_im_context *ctx, float x, float y, float z);
+GOAT3DAPI void goat3d_im_texcoord2f(struct goat3d_im_context *ctx, float x, float y);
+GOAT3DAPI void goat3d_im_skin_weight4f(struct goat3d_im_context *ctx, float x, float y, float z, float w);
+GOAT3DAPI void goat3d_im_skin_matrix4i(struct goat3d_im_context *ctx, int x, int y, int z, int w);
+GOAT3DAPI void goat3d_im_color3f(struct goat3d_im_context *ctx, float x, float y, float z);
+GOAT3DAPI void goat3d_im_color4f(struct goat3d_im_context *ctx, float x, float y, float z, float w);
+/* submits count vertices at once. Attributes with an array get one value per
+ * vertex from it (tightly packed, same number of components as the goat3d_im_*
+ * functions), the rest get their current value, as with goat3d_im_vertex3f.
+ * Positions are mandatory.
+ */
+GOAT3DAPI int goat3d_im_vertex_arrays(struct goat3d_im_context *ctx, const struct goat3d_im_arrays *arr, int count);
+
 GOAT3DAPI void goat3d_get_mesh_bounds(const struct goat3d_mesh *mesh, float *bmin, float *bmax);
 
+/* memory usage of a single mesh, see goat3d_get_memory_stats */
+GOAT3DAPI void goat3d_get_mesh_memory_stats(const struct goat3d_mesh *mesh, struct goat3d_memory_stats *stats);
+
+/* skinning
+ * bones are referenced by index from the GOAT3D_MESH_ATTR_SKIN_MATRIX vertex
+ * attribute, in the order they were added. inv_bind is the inverse of the bone
+ * world matrix in the bind pose, or null to use the bone matrix at time 0.
+ */
+GOAT3DAPI int goat3d_add_mesh_bone(struct goat3d_mesh *mesh, struct goat3d_node *bone, const float *inv_bind);
+GOAT3DAPI int goat3d_get_mesh_bone_count(const struct goat3d_mesh *mesh);
+GOAT3DAPI struct goat3d_node *goat3d_get_mesh_bone(const struct goat3d_mesh *mesh, int idx);
+
+/* deforms the mesh with 4-weight linear blend skinning, using the bone poses of
+ * the active animation at time tmsec. Writes 3 floats per vertex to out_pos,
+ * and if out_norm is not null, and the mesh has normals, 3 floats per vertex to
+ * out_norm. The mesh itself is not modified.
+ */
+GOAT3DAPI int goat3d_skin_mesh(struct goat3d_mesh *mesh, long tmsec, float *out_pos, float *out_norm);
+
 /* lights */
 GOAT3DAPI int goat3d_add_light(struct goat3d *g, struct goat3d_light *lt);
 GOAT3DAPI int goat3d_get_light_count(struct goat3d *g);
@@ -292,6 +647,38 @@ GOAT3DAPI void goat3d_get_node_matrix(const struct goat3d_node *node, float *mat
 
 GOAT3DAPI void goat3d_get_node_bounds(const struct goat3d_node *node, float *bmin, float *bmax);
 
+/* baked animations
+ * goat3d_bake_anim resamples animation anim_idx of every node in the scene, at a
+ * fixed rate of rate_hz frames per second, into contiguous per-component arrays.
+ * Playback of baked animations doesn't depend on the scene, or on the active
+ * animations of the nodes.
+ */
+GOAT3DAPI struct goat3d_baked_anim *goat3d_bake_anim(struct goat3d *g, int anim_idx, float rate_hz);
+GOAT3DAPI void goat3d_free_baked_anim(struct goat3d_baked_anim *ba);
+
+GOAT3DAPI int goat3d_get_baked_frame_count(const struct goat3d_baked_anim *ba);
+GOAT3DAPI int goat3d_get_baked_node_count(const struct goat3d_baked_anim *ba);
+GOAT3DAPI long goat3d_get_baked_timeline(const struct goat3d_baked_anim *ba, long *tstart, long *tend);
+
+/* samples all nodes at time tmsec (clamped to the baked time range), by linear
+ * interpolation between the nearest frames (nlerp for rotations).
+ * out must have room for NUM_GOAT3D_BAKED_COMPS floats per node, laid out as
+ * one array of node-count floats per component (see enum goat3d_baked_comp),
+ * with nodes in the same order as goat3d_get_node:
+ *   out[comp * node_count + node_idx]
+ */
+GOAT3DAPI void goat3d_sample_baked(const struct goat3d_baked_anim *ba, long tmsec, float *out);
+
+/* evaluates the world matrices of every node in the scene, once for each job,
+ * spreading the jobs across the library worker threads. Each job can be a
+ * different instance of the same scene, with its own time and animation blend.
+ * Unlike goat3d_use_anims/goat3d_get_node_matrix, this doesn't change the
+ * active animation state of the nodes, and can run concurrently with other
+ * evaluations of the same scene. Matrices have the same layout as
+ * goat3d_get_node_matrix.
+ */
+GOAT3DAPI int goat3d_eval_anim_jobs(const struct goat3d *g, struct goat3d_anim_job *jobs, int num_jobs);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "goat3d.h"
 #include "object.h"
 #include "aabox.h"
+#include "arena.h"
 
 struct goat3d {
 	unsigned int flags;
@@ -37,8 +38,35 @@ struct goat3d {
 	struct goat3d_camera **cameras;
 	struct goat3d_node **nodes;
 
+	/* computed on demand by goat3d_get_bounds, and published atomically, see
+	 * the BBOX_* states below
+	 */
 	struct aabox bbox;
 	int bbox_valid;
+
+	/* loaded scene data is allocated from this arena, and released all at
+	 * once by goat3d_clear
+	 */
+	struct arena *arena;
+	/* arenas of the scenes we were cloned from, holding data shared with
+	 * them (dynarr, see goat3d_clone)
+	 */
+	struct arena **shared_arenas;
+
+	struct load_state *load;	/* non-null during goat3d_load_async */
+};
+
+/* bbox_valid states. The first thread to query the bounds moves it from
+ * invalid to updating, fills in bbox, and publishes it by setting it to valid.
+ * Threads querying the bounds in the meantime compute their own copy.
+ */
+enum { BBOX_INVALID, BBOX_UPDATING, BBOX_VALID };
+
+/* progress of an asynchronous load, updated by the loading thread */
+struct load_state {
+	long bytes;			/* bytes read so far */
+	int objects;		/* objects loaded so far */
+	int cancel;			/* set by goat3d_load_cancel */
 };
 
 extern int goat3d_log_level;
@@ -55,10 +83,29 @@ void io_vfprintf(goat3d_io *io, const char *fmt, va_list ap);
 
 char *g3dimpl_clean_filename(char *str);
 
+int g3dimpl_set_search_path(struct goat3d *g, const char *fname);
+
+/* called by the loaders after each object, returns -1 if the load was
+ * cancelled (see goat3d_load_async)
+ */
+int g3dimpl_load_progress(struct goat3d *g);
+
 int g3dimpl_scnload(struct goat3d *g, struct goat3d_io *io);
 int g3dimpl_anmload(struct goat3d *g, struct goat3d_io *io);
 
 int g3dimpl_scnsave(const struct goat3d *g, struct goat3d_io *io);
 int g3dimpl_anmsave(const struct goat3d *g, struct goat3d_io *io);
 
+/* unbuffered versions, working directly on treestore I/O callbacks */
+struct ts_io;
+int g3dimpl_scnload_tsio(struct goat3d *g, struct ts_io *tsio);
+int g3dimpl_scnsave_tsio(const struct goat3d *g, struct ts_io *tsio);
+
+/* loads a scene from memory, with the text scene parser if possible, or the
+ * treestore loader otherwise
+ */
+int g3dimpl_scnload_mem(struct goat3d *g, const void *buf, size_t size);
+/* the text scene parser (textload.c), returns 1 if it can't handle the file */
+int g3dimpl_scnload_text(struct goat3d *g, const char *text, size_t size);
+
 #endif	/* GOAT3D_IMPL_H_ */
@@ -0,0 +1,394 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "dynarr.h"
+#include "log.h"
+
+struct goat3d_im_context {
+	struct goat3d_mesh *mesh;
+	enum goat3d_im_primitive prim;
+
+	/* current vertex attributes */
+	cgm_vec3 norm, tang;
+	cgm_vec2 texcoord;
+	cgm_vec4 skinw, color;
+	int4 skinmat;
+	int use[NUM_GOAT3D_MESH_ATTRIBS];
+};
+
+static int reserve_vattr(struct goat3d_mesh *mesh, void **arr, int count);
+static void append_vattr(void **arr, int szelem, const void *data, int count);
+static void fill_vattr(void **arr, int szelem, const void *val, int count);
+
+/* context used by the global immediate mode functions */
+static struct goat3d_im_context def_ctx = {0, GOAT3D_TRIANGLES, {0}, {0}, {0}, {0}, {1, 1, 1, 1}};
+
+
+GOAT3DAPI struct goat3d_im_context *goat3d_create_im_context(void)
+{
+	struct goat3d_im_context *ctx;
+
+	if(!(ctx = g3dimpl_malloc(sizeof *ctx))) {
+		return 0;
+	}
+	memset(ctx, 0, sizeof *ctx);
+	cgm_wcons(&ctx->color, 1, 1, 1, 1);
+	return ctx;
+}
+
+GOAT3DAPI void goat3d_free_im_context(struct goat3d_im_context *ctx)
+{
+	g3dimpl_free(ctx);
+}
+
+GOAT3DAPI void goat3d_im_begin(struct goat3d_im_context *ctx, struct goat3d_mesh *mesh,
+		enum goat3d_im_primitive prim)
+{
+	DYNARR_CLEAR(mesh->vertices);
+	DYNARR_CLEAR(mesh->normals);
+	DYNARR_CLEAR(mesh->tangents);
+	DYNARR_CLEAR(mesh->texcoords);
+	DYNARR_CLEAR(mesh->skin_weights);
+	DYNARR_CLEAR(mesh->skin_matrices);
+	DYNARR_CLEAR(mesh->colors);
+	DYNARR_CLEAR(mesh->faces);
+
+	ctx->mesh = mesh;
+	memset(ctx->use, 0, sizeof ctx->use);
+
+	ctx->prim = prim;
+}
+
+GOAT3DAPI int goat3d_im_end(struct goat3d_im_context *ctx)
+{
+	int i, vidx, num_faces, num_quads;
+	struct goat3d_mesh *mesh = ctx->mesh;
+	void *tmp;
+
+	switch(ctx->prim) {
+	case GOAT3D_TRIANGLES:
+		{
+			num_faces = dynarr_size(mesh->vertices) / 3;
+			if(!(tmp = dynarr_resize(mesh->faces, num_faces))) {
+				goto err;
+			}
+			mesh->faces = tmp;
+
+			vidx = 0;
+			for(i=0; i<num_faces; i++) {
+				mesh->faces[i].v[0] = vidx++;
+				mesh->faces[i].v[1] = vidx++;
+				mesh->faces[i].v[2] = vidx++;
+			}
+		}
+		break;
+
+	case GOAT3D_QUADS:
+		{
+			num_quads = dynarr_size(mesh->vertices) / 4;
+			if(!(tmp = dynarr_resize(mesh->faces, num_quads * 2))) {
+				goto err;
+			}
+			mesh->faces = tmp;
+
+			vidx = 0;
+			for(i=0; i<num_quads; i++) {
+				mesh->faces[i * 2].v[0] = vidx;
+				mesh->faces[i * 2].v[1] = vidx + 1;
+				mesh->faces[i * 2].v[2] = vidx + 2;
+
+				mesh->faces[i * 2 + 1].v[0] = vidx;
+				mesh->faces[i * 2 + 1].v[1] = vidx + 2;
+				mesh->faces[i * 2 + 1].v[2] = vidx + 3;
+
+				vidx += 4;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+	return 0;
+
+err:
+	goat3d_logmsg(LOG_ERROR, "goat3d_im_end: failed to allocate faces for mesh %s\n", mesh->name);
+	return -1;
+}
+
+GOAT3DAPI int goat3d_im_reserve(struct goat3d_im_context *ctx, int nverts)
+{
+	int nfaces = ctx->prim == GOAT3D_QUADS ? nverts / 2 : nverts / 3;
+	return goat3d_reserve_mesh(ctx->mesh, nverts, nfaces);
+}
+
+GOAT3DAPI void goat3d_im_vertex3f(struct goat3d_im_context *ctx, float x, float y, float z)
+{
+	void *tmp;
+	cgm_vec3 v;
+	struct goat3d_mesh *mesh = ctx->mesh;
+
+	cgm_vcons(&v, x, y, z);
+	if(!(tmp = dynarr_push(mesh->vertices, &v))) {
+		return;
+	}
+	mesh->vertices = tmp;
+
+	if(ctx->use[GOAT3D_MESH_ATTR_NORMAL]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->normals, &ctx->norm))) {
+			mesh->normals = tmp;
+		}
+	}
+	if(ctx->use[GOAT3D_MESH_ATTR_TANGENT]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->tangents, &ctx->tang))) {
+			mesh->tangents = tmp;
+		}
+	}
+	if(ctx->use[GOAT3D_MESH_ATTR_TEXCOORD]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->texcoords, &ctx->texcoord))) {
+			mesh->texcoords = tmp;
+		}
+	}
+	if(ctx->use[GOAT3D_MESH_ATTR_SKIN_WEIGHT]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->skin_weights, &ctx->skinw))) {
+			mesh->skin_weights = tmp;
+		}
+	}
+	if(ctx->use[GOAT3D_MESH_ATTR_SKIN_MATRIX]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->skin_matrices, &ctx->skinmat))) {
+			mesh->skin_matrices = tmp;
+		}
+	}
+	if(ctx->use[GOAT3D_MESH_ATTR_COLOR]) {
+		if((tmp = g3dimpl_mesh_push_vattr(mesh, mesh->colors, &ctx->color))) {
+			mesh->colors = tmp;
+		}
+	}
+}
+
+GOAT3DAPI void goat3d_im_normal3f(struct goat3d_im_context *ctx, float x, float y, float z)
+{
+	cgm_vcons(&ctx->norm, x, y, z);
+	ctx->use[GOAT3D_MESH_ATTR_NORMAL] = 1;
+}
+
+GOAT3DAPI void goat3d_im_tangent3f(struct goat3d_im_context *ctx, float x, float y, float z)
+{
+	cgm_vcons(&ctx->tang, x, y, z);
+	ctx->use[GOAT3D_MESH_ATTR_TANGENT] = 1;
+}
+
+GOAT3DAPI void goat3d_im_texcoord2f(struct goat3d_im_context *ctx, float x, float y)
+{
+	ctx->texcoord.x = x;
+	ctx->texcoord.y = y;
+	ctx->use[GOAT3D_MESH_ATTR_TEXCOORD] = 1;
+}
+
+GOAT3DAPI void goat3d_im_skin_weight4f(struct goat3d_im_context *ctx, float x, float y, float z, float w)
+{
+	cgm_wcons(&ctx->skinw, x, y, z, w);
+	ctx->use[GOAT3D_MESH_ATTR_SKIN_WEIGHT] = 1;
+}
+
+GOAT3DAPI void goat3d_im_skin_matrix4i(struct goat3d_im_context *ctx, int x, int y, int z, int w)
+{
+	ctx->skinmat.x = x;
+	ctx->skinmat.y = y;
+	ctx->skinmat.z = z;
+	ctx->skinmat.w = w;
+	ctx->use[GOAT3D_MESH_ATTR_SKIN_MATRIX] = 1;
+}
+
+GOAT3DAPI void goat3d_im_color3f(struct goat3d_im_context *ctx, float x, float y, float z)
+{
+	goat3d_im_color4f(ctx, x, y, z, 1.0f);
+}
+
+GOAT3DAPI void goat3d_im_color4f(struct goat3d_im_context *ctx, float x, float y, float z, float w)
+{
+	cgm_wcons(&ctx->color, x, y, z, w);
+	ctx->use[GOAT3D_MESH_ATTR_COLOR] = 1;
+}
+
+GOAT3DAPI int goat3d_im_vertex_arrays(struct goat3d_im_context *ctx, const struct goat3d_im_arrays *arr, int count)
+{
+	int i;
+	struct goat3d_mesh *mesh = ctx->mesh;
+	void **marr[NUM_GOAT3D_MESH_ATTRIBS];
+	const void *data[NUM_GOAT3D_MESH_ATTRIBS];
+	void *cur[NUM_GOAT3D_MESH_ATTRIBS];
+	static const int szelem[NUM_GOAT3D_MESH_ATTRIBS] = {
+		sizeof(cgm_vec3), sizeof(cgm_vec3), sizeof(cgm_vec3), sizeof(cgm_vec2),
+		sizeof(cgm_vec4), sizeof(int4), sizeof(cgm_vec4)
+	};
+
+	if(count <= 0) return 0;
+
+	if(!arr->vertices) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_im_vertex_arrays: missing vertex positions\n");
+		return -1;
+	}
+	marr[GOAT3D_MESH_ATTR_VERTEX] = (void**)&mesh->vertices;
+	marr[GOAT3D_MESH_ATTR_NORMAL] = (void**)&mesh->normals;
+	marr[GOAT3D_MESH_ATTR_TANGENT] = (void**)&mesh->tangents;
+	marr[GOAT3D_MESH_ATTR_TEXCOORD] = (void**)&mesh->texcoords;
+	marr[GOAT3D_MESH_ATTR_SKIN_WEIGHT] = (void**)&mesh->skin_weights;
+	marr[GOAT3D_MESH_ATTR_SKIN_MATRIX] = (void**)&mesh->skin_matrices;
+	marr[GOAT3D_MESH_ATTR_COLOR] = (void**)&mesh->colors;
+
+	data[GOAT3D_MESH_ATTR_VERTEX] = arr->vertices;
+	data[GOAT3D_MESH_ATTR_NORMAL] = arr->normals;
+	data[GOAT3D_MESH_ATTR_TANGENT] = arr->tangents;
+	data[GOAT3D_MESH_ATTR_TEXCOORD] = arr->texcoords;
+	data[GOAT3D_MESH_ATTR_SKIN_WEIGHT] = arr->skin_weights;
+	data[GOAT3D_MESH_ATTR_SKIN_MATRIX] = arr->skin_matrices;
+	data[GOAT3D_MESH_ATTR_COLOR] = arr->colors;
+
+	cur[GOAT3D_MESH_ATTR_VERTEX] = 0;
+	cur[GOAT3D_MESH_ATTR_NORMAL] = &ctx->norm;
+	cur[GOAT3D_MESH_ATTR_TANGENT] = &ctx->tang;
+	cur[GOAT3D_MESH_ATTR_TEXCOORD] = &ctx->texcoord;
+	cur[GOAT3D_MESH_ATTR_SKIN_WEIGHT] = &ctx->skinw;
+	cur[GOAT3D_MESH_ATTR_SKIN_MATRIX] = &ctx->skinmat;
+	cur[GOAT3D_MESH_ATTR_COLOR] = &ctx->color;
+
+	/* make room in every array first, so that failing half-way through can't
+	 * leave the attribute arrays with different lengths
+	 */
+	for(i=0; i<NUM_GOAT3D_MESH_ATTRIBS; i++) {
+		if(data[i] || (cur[i] && ctx->use[i])) {
+			if(reserve_vattr(mesh, marr[i], count) == -1) {
+				goat3d_logmsg(LOG_ERROR, "goat3d_im_vertex_arrays: failed to add %d vertices to mesh %s\n",
+						count, mesh->name);
+				return -1;
+			}
+		}
+	}
+
+	for(i=0; i<NUM_GOAT3D_MESH_ATTRIBS; i++) {
+		if(data[i]) {
+			append_vattr(marr[i], szelem[i], data[i], count);
+			if(cur[i]) {
+				/* the last value becomes the current one, as if each vertex
+				 * was submitted one by one
+				 */
+				memcpy(cur[i], (char*)*marr[i] + (dynarr_size(*marr[i]) - 1) * szelem[i], szelem[i]);
+				ctx->use[i] = 1;
+			}
+		} else if(cur[i] && ctx->use[i]) {
+			fill_vattr(marr[i], szelem[i], cur[i], count);
+		}
+	}
+	return 0;
+}
+
+/* global immediate mode interface, using the default context */
+GOAT3DAPI void goat3d_begin(struct goat3d_mesh *mesh, enum goat3d_im_primitive prim)
+{
+	goat3d_im_begin(&def_ctx, mesh, prim);
+}
+
+GOAT3DAPI void goat3d_end(void)
+{
+	goat3d_im_end(&def_ctx);
+}
+
+GOAT3DAPI void goat3d_vertex3f(float x, float y, float z)
+{
+	goat3d_im_vertex3f(&def_ctx, x, y, z);
+}
+
+GOAT3DAPI void goat3d_normal3f(float x, float y, float z)
+{
+	goat3d_im_normal3f(&def_ctx, x, y, z);
+}
+
+GOAT3DAPI void goat3d_tangent3f(float x, float y, float z)
+{
+	goat3d_im_tangent3f(&def_ctx, x, y, z);
+}
+
+GOAT3DAPI void goat3d_texcoord2f(float x, float y)
+{
+	goat3d_im_texcoord2f(&def_ctx, x, y);
+}
+
+GOAT3DAPI void goat3d_skin_weight4f(float x, float y, float z, float w)
+{
+	goat3d_im_skin_weight4f(&def_ctx, x, y, z, w);
+}
+
+GOAT3DAPI void goat3d_skin_matrix4i(int x, int y, int z, int w)
+{
+	goat3d_im_skin_matrix4i(&def_ctx, x, y, z, w);
+}
+
+GOAT3DAPI void goat3d_color3f(float x, float y, float z)
+{
+	goat3d_im_color4f(&def_ctx, x, y, z, 1.0f);
+}
+
+GOAT3DAPI void goat3d_color4f(float x, float y, float z, float w)
+{
+	goat3d_im_color4f(&def_ctx, x, y, z, w);
+}
+
+/* makes room for count more elements in a vertex attribute array, reserving
+ * space for all the vertices reserved with goat3d_reserve_mesh if it's empty
+ */
+static int reserve_vattr(struct goat3d_mesh *mesh, void **arr, int count)
+{
+	size_t num, cap;
+	void *tmp;
+
+	num = dynarr_size(*arr);
+	cap = num + count;
+	if(num == 0 && cap < (size_t)mesh->reserved_verts) {
+		cap = mesh->reserved_verts;
+	}
+	if(!(tmp = dynarr_reserve(*arr, cap))) {
+		return -1;
+	}
+	*arr = tmp;
+	return 0;
+}
+
+/* reserve_vattr must be called first, these can't fail */
+static void append_vattr(void **arr, int szelem, const void *data, int count)
+{
+	size_t num = dynarr_size(*arr);
+	*arr = dynarr_resize(*arr, num + count);
+	memcpy((char*)*arr + num * szelem, data, (size_t)count * szelem);
+}
+
+static void fill_vattr(void **arr, int szelem, const void *val, int count)
+{
+	int i;
+	size_t num = dynarr_size(*arr);
+	char *dest;
+
+	*arr = dynarr_resize(*arr, num + count);
+	dest = (char*)*arr + num * szelem;
+	for(i=0; i<count; i++) {
+		memcpy(dest, val, szelem);
+		dest += szelem;
+	}
+}
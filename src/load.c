@@ -0,0 +1,195 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "g3datomic.h"
+#include "log.h"
+
+struct goat3d_load {
+	struct goat3d *g;
+	char *fname;
+	unsigned int flags;
+	goat3d_load_done_func done_func;
+	void *cls;
+
+	pthread_t thread;
+	FILE *fp;
+	long total_bytes;
+	struct load_state st;
+
+	int done;
+	int result;
+};
+
+static void *load_thread(void *arg);
+static long read_file(void *buf, size_t bytes, void *uptr);
+static long write_file(const void *buf, size_t bytes, void *uptr);
+static long seek_file(long offs, int whence, void *uptr);
+
+GOAT3DAPI struct goat3d_load *goat3d_load_async(struct goat3d *g, const char *fname, unsigned int flags,
+		goat3d_load_done_func done_func, void *cls)
+{
+	struct goat3d_load *ld;
+
+	if(!(ld = g3dimpl_malloc(sizeof *ld))) {
+		return 0;
+	}
+	memset(ld, 0, sizeof *ld);
+	ld->g = g;
+	ld->flags = flags;
+	ld->done_func = done_func;
+	ld->cls = cls;
+
+	if(!(ld->fname = g3dimpl_malloc(strlen(fname) + 1))) {
+		goto err;
+	}
+	strcpy(ld->fname, fname);
+
+	/* open the file here, to report missing files right away */
+	if(!(ld->fp = fopen(fname, "rb"))) {
+		goat3d_logmsg(LOG_ERROR, "failed to open file \"%s\" for reading: %s\n", fname, strerror(errno));
+		goto err;
+	}
+	fseek(ld->fp, 0, SEEK_END);
+	ld->total_bytes = ftell(ld->fp);
+	rewind(ld->fp);
+
+	if(pthread_create(&ld->thread, 0, load_thread, ld) != 0) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_load_async: failed to start loading thread\n");
+		fclose(ld->fp);
+		goto err;
+	}
+	return ld;
+
+err:
+	g3dimpl_free(ld->fname);
+	g3dimpl_free(ld);
+	return 0;
+}
+
+GOAT3DAPI int goat3d_load_poll(struct goat3d_load *ld, struct goat3d_load_progress *prog)
+{
+	if(prog) {
+		prog->bytes = g3dimpl_atomic_add(&ld->st.bytes, 0);
+		prog->total_bytes = ld->total_bytes;
+		prog->objects = g3dimpl_atomic_add(&ld->st.objects, 0);
+	}
+	if(!g3dimpl_atomic_add(&ld->done, 0)) {
+		return 1;
+	}
+	return ld->result;
+}
+
+GOAT3DAPI int goat3d_load_wait(struct goat3d_load *ld)
+{
+	int res;
+
+	pthread_join(ld->thread, 0);
+	res = ld->result;
+
+	g3dimpl_free(ld->fname);
+	g3dimpl_free(ld);
+	return res;
+}
+
+GOAT3DAPI void goat3d_load_cancel(struct goat3d_load *ld)
+{
+	g3dimpl_atomic_cas(&ld->st.cancel, 0, 1);
+}
+
+int g3dimpl_load_progress(struct goat3d *g)
+{
+	if(!g->load) return 0;
+
+	g3dimpl_atomic_add(&g->load->objects, 1);
+	return g3dimpl_atomic_add(&g->load->cancel, 0) ? -1 : 0;
+}
+
+static void *load_thread(void *arg)
+{
+	struct goat3d_load *ld = arg;
+	struct goat3d *g = ld->g;
+	struct goat3d_io io;
+	int res;
+
+	io.cls = ld;
+	io.read = read_file;
+	io.write = write_file;
+	io.seek = seek_file;
+
+	g->load = &ld->st;
+	if(ld->flags & GOAT3D_LOAD_ANIM) {
+		res = g3dimpl_anmload(g, &io);
+	} else {
+		if((res = g3dimpl_set_search_path(g, ld->fname)) != -1) {
+			res = g3dimpl_scnload(g, &io);
+		}
+		if(res == -1) {
+			/* don't leave a half-loaded scene behind */
+			goat3d_clear(g);
+		}
+	}
+	g->load = 0;
+	fclose(ld->fp);
+
+	if(res == -1 && ld->st.cancel) {
+		goat3d_logmsg(LOG_INFO, "loading %s cancelled\n", ld->fname);
+	}
+
+	ld->result = res;
+	g3dimpl_atomic_add(&ld->done, 1);
+
+	if(ld->done_func) {
+		ld->done_func(g, res, ld->cls);
+	}
+	return 0;
+}
+
+/* reads fail as soon as the load is cancelled, to stop parsing early */
+static long read_file(void *buf, size_t bytes, void *uptr)
+{
+	struct goat3d_load *ld = uptr;
+	long res;
+
+	if(g3dimpl_atomic_add(&ld->st.cancel, 0)) {
+		return -1;
+	}
+	if((res = (long)fread(buf, 1, bytes, ld->fp)) > 0) {
+		g3dimpl_atomic_add(&ld->st.bytes, res);
+	}
+	return res;
+}
+
+static long write_file(const void *buf, size_t bytes, void *uptr)
+{
+	return -1;
+}
+
+static long seek_file(long offs, int whence, void *uptr)
+{
+	struct goat3d_load *ld = uptr;
+
+	if(fseek(ld->fp, offs, whence) == -1) {
+		return -1;
+	}
+	return ftell(ld->fp);
+}
@@ -0,0 +1,166 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "dynarr.h"
+
+static void mesh_usage(struct goat3d_memory_stats *stats, const struct goat3d_mesh *mesh);
+static void mtl_usage(struct goat3d_memory_stats *stats, const struct goat3d_material *mtl);
+static void node_usage(struct goat3d_memory_stats *stats, struct goat3d_node *node);
+static void add_bytes(struct goat3d_memory_stats *stats, int cat, size_t sz);
+static void add_str(struct goat3d_memory_stats *stats, const char *str);
+static void sum_total(struct goat3d_memory_stats *stats);
+
+GOAT3DAPI void goat3d_get_memory_stats(const struct goat3d *g, struct goat3d_memory_stats *stats)
+{
+	int i, num;
+	struct goat3d_mem_usage *scn;
+
+	memset(stats, 0, sizeof *stats);
+
+	scn = stats->cat + GOAT3D_MEM_SCENE;
+	add_bytes(stats, GOAT3D_MEM_SCENE, sizeof *g);
+	dynarr_mem_usage(g->materials, &scn->used, &scn->reserved);
+	dynarr_mem_usage(g->meshes, &scn->used, &scn->reserved);
+	dynarr_mem_usage(g->lights, &scn->used, &scn->reserved);
+	dynarr_mem_usage(g->cameras, &scn->used, &scn->reserved);
+	dynarr_mem_usage(g->nodes, &scn->used, &scn->reserved);
+	add_str(stats, g->name);
+	add_str(stats, g->search_path);
+
+	num = dynarr_size(g->materials);
+	for(i=0; i<num; i++) {
+		mtl_usage(stats, g->materials[i]);
+	}
+	num = dynarr_size(g->meshes);
+	for(i=0; i<num; i++) {
+		mesh_usage(stats, g->meshes[i]);
+	}
+	num = dynarr_size(g->lights);
+	for(i=0; i<num; i++) {
+		add_bytes(stats, GOAT3D_MEM_OBJECTS, sizeof *g->lights[i]);
+		add_str(stats, g->lights[i]->name);
+	}
+	num = dynarr_size(g->cameras);
+	for(i=0; i<num; i++) {
+		add_bytes(stats, GOAT3D_MEM_OBJECTS, sizeof *g->cameras[i]);
+		add_str(stats, g->cameras[i]->name);
+	}
+	num = dynarr_size(g->nodes);
+	for(i=0; i<num; i++) {
+		node_usage(stats, g->nodes[i]);
+	}
+
+	sum_total(stats);
+
+	stats->arena.used = g->arena->used;
+	stats->arena.reserved = g->arena->reserved;
+}
+
+GOAT3DAPI void goat3d_get_mesh_memory_stats(const struct goat3d_mesh *mesh, struct goat3d_memory_stats *stats)
+{
+	memset(stats, 0, sizeof *stats);
+	mesh_usage(stats, mesh);
+	sum_total(stats);
+}
+
+static void mesh_usage(struct goat3d_memory_stats *stats, const struct goat3d_mesh *mesh)
+{
+	struct goat3d_mem_usage *bones = stats->cat + GOAT3D_MEM_BONES;
+
+#define ATTR_USAGE(c, arr) \
+	dynarr_mem_usage(arr, &stats->cat[c].used, &stats->cat[c].reserved)
+
+	add_bytes(stats, GOAT3D_MEM_OBJECTS, sizeof *mesh);
+	add_str(stats, mesh->name);
+
+	ATTR_USAGE(GOAT3D_MEM_VERTICES, mesh->vertices);
+	ATTR_USAGE(GOAT3D_MEM_NORMALS, mesh->normals);
+	ATTR_USAGE(GOAT3D_MEM_TANGENTS, mesh->tangents);
+	ATTR_USAGE(GOAT3D_MEM_TEXCOORDS, mesh->texcoords);
+	ATTR_USAGE(GOAT3D_MEM_SKIN_WEIGHTS, mesh->skin_weights);
+	ATTR_USAGE(GOAT3D_MEM_SKIN_MATRICES, mesh->skin_matrices);
+	ATTR_USAGE(GOAT3D_MEM_COLORS, mesh->colors);
+	ATTR_USAGE(GOAT3D_MEM_FACES, mesh->faces);
+
+	dynarr_mem_usage(mesh->bones, &bones->used, &bones->reserved);
+	dynarr_mem_usage(mesh->bone_invbind, &bones->used, &bones->reserved);
+
+#undef ATTR_USAGE
+}
+
+static void mtl_usage(struct goat3d_memory_stats *stats, const struct goat3d_material *mtl)
+{
+	int i, num;
+	struct goat3d_mem_usage *mu = stats->cat + GOAT3D_MEM_MATERIALS;
+
+	add_bytes(stats, GOAT3D_MEM_MATERIALS, sizeof *mtl);
+	dynarr_mem_usage(mtl->attrib, &mu->used, &mu->reserved);
+	add_str(stats, mtl->name);
+
+	/* attribute names are interned, only the map names belong to the material */
+	num = dynarr_size(mtl->attrib);
+	for(i=0; i<num; i++) {
+		add_str(stats, mtl->attrib[i].map);
+	}
+}
+
+static void node_usage(struct goat3d_memory_stats *stats, struct goat3d_node *node)
+{
+	int i, j, num;
+	struct anm_animation *anim;
+
+	add_bytes(stats, GOAT3D_MEM_NODES, sizeof *node);
+	add_str(stats, anm_get_node_name(&node->anm));
+
+	num = anm_get_animation_count(&node->anm);
+	for(i=0; i<num; i++) {
+		if(!(anim = anm_get_animation(&node->anm, i))) continue;
+
+		add_bytes(stats, GOAT3D_MEM_ANIM_KEYS, sizeof *anim);
+		add_str(stats, anim->name);
+		for(j=0; j<ANM_NUM_TRACKS; j++) {
+			add_bytes(stats, GOAT3D_MEM_ANIM_KEYS, anim->tracks[j].count * sizeof *anim->tracks[j].keys);
+		}
+	}
+}
+
+static void add_bytes(struct goat3d_memory_stats *stats, int cat, size_t sz)
+{
+	stats->cat[cat].used += sz;
+	stats->cat[cat].reserved += sz;
+}
+
+static void add_str(struct goat3d_memory_stats *stats, const char *str)
+{
+	if(str) {
+		add_bytes(stats, GOAT3D_MEM_NAMES, strlen(str) + 1);
+	}
+}
+
+static void sum_total(struct goat3d_memory_stats *stats)
+{
+	int i;
+
+	stats->total.used = stats->total.reserved = 0;
+	for(i=0; i<NUM_GOAT3D_MEM_CATEGORIES; i++) {
+		stats->total.used += stats->cat[i].used;
+		stats->total.reserved += stats->cat[i].reserved;
+	}
+}
@@ -18,33 +18,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include "object.h"
 #include "dynarr.h"
+#include "atom.h"
+#include "g3datomic.h"
 
-int g3dimpl_obj_init(struct object *o, int type)
+/* default object name counters, shared by all threads */
+static int last_mesh, last_light, last_camera;
+
+int g3dimpl_obj_init(struct object *o, int type, struct arena *arena)
 {
-	static int last_mesh, last_light, last_camera;
 	struct goat3d_mesh *m;
 	struct goat3d_light *lt;
 	struct goat3d_camera *cam;
-	char *name;
-
-	if(!(name = malloc(64))) {
-		return -1;
-	}
 
 	switch(type) {
 	case OBJTYPE_MESH:
 		m = (struct goat3d_mesh*)o;
 		memset(m, 0, sizeof *m);
-		if(!(m->vertices = dynarr_alloc(0, sizeof *m->vertices))) goto err;
-		if(!(m->normals = dynarr_alloc(0, sizeof *m->normals))) goto err;
-		if(!(m->tangents = dynarr_alloc(0, sizeof *m->tangents))) goto err;
-		if(!(m->texcoords = dynarr_alloc(0, sizeof *m->texcoords))) goto err;
-		if(!(m->skin_weights = dynarr_alloc(0, sizeof *m->skin_weights))) goto err;
-		if(!(m->skin_matrices = dynarr_alloc(0, sizeof *m->skin_matrices))) goto err;
-		if(!(m->colors = dynarr_alloc(0, sizeof *m->colors))) goto err;
-		if(!(m->faces = dynarr_alloc(0, sizeof *m->faces))) goto err;
-		if(!(m->bones = dynarr_alloc(0, sizeof *m->bones))) goto err;
-		sprintf(name, "mesh%d", last_mesh++);
+		if(!(m->vertices = dynarr_alloc_arena(0, sizeof *m->vertices, arena))) goto err;
+		if(!(m->normals = dynarr_alloc_arena(0, sizeof *m->normals, arena))) goto err;
+		if(!(m->tangents = dynarr_alloc_arena(0, sizeof *m->tangents, arena))) goto err;
+		if(!(m->texcoords = dynarr_alloc_arena(0, sizeof *m->texcoords, arena))) goto err;
+		if(!(m->skin_weights = dynarr_alloc_arena(0, sizeof *m->skin_weights, arena))) goto err;
+		if(!(m->skin_matrices = dynarr_alloc_arena(0, sizeof *m->skin_matrices, arena))) goto err;
+		if(!(m->colors = dynarr_alloc_arena(0, sizeof *m->colors, arena))) goto err;
+		if(!(m->faces = dynarr_alloc_arena(0, sizeof *m->faces, arena))) goto err;
+		if(!(m->bones = dynarr_alloc_arena(0, sizeof *m->bones, arena))) goto err;
+		if(!(m->bone_invbind = dynarr_alloc_arena(0, 16 * sizeof *m->bone_invbind, arena))) goto err;
+		sprintf(o->defname, "mesh%d", g3dimpl_atomic_add(&last_mesh, 1) - 1);
 		break;
 
 	case OBJTYPE_LIGHT:
@@ -55,7 +55,7 @@ int g3dimpl_obj_init(struct object *o, int type)
 		cgm_vcons(&lt->dir, 0, 0, 1);
 		lt->inner_cone = cgm_deg_to_rad(30);
 		lt->outer_cone = cgm_deg_to_rad(45);
-		sprintf(name, "light%d", last_light++);
+		sprintf(o->defname, "light%d", g3dimpl_atomic_add(&last_light, 1) - 1);
 		break;
 
 	case OBJTYPE_CAMERA:
@@ -64,21 +64,26 @@ int g3dimpl_obj_init(struct object *o, int type)
 		cam->near_clip = 0.5f;
 		cam->far_clip = 500.0f;
 		cgm_vcons(&cam->up, 0, 1, 0);
-		sprintf(name, "camera%d", last_camera++);
+		sprintf(o->defname, "camera%d", g3dimpl_atomic_add(&last_camera, 1) - 1);
 		break;
 
 	default:
 		return -1;
 	}
 
-	o->name = name;
+	/* the default name lives in the object itself, to avoid allocating a
+	 * string which is usually replaced right away
+	 */
+	o->name = o->defname;
 	o->type = type;
+	o->arena = arena;
 	cgm_qcons(&o->rot, 0, 0, 0, 1);
 	cgm_vcons(&o->scale, 1, 1, 1);
 	return 0;
 
 err:
-	free(name);
+	o->name = o->defname;
+	o->arena = arena;
 	g3dimpl_obj_destroy(o);
 	return -1;
 }
@@ -87,6 +92,12 @@ void g3dimpl_obj_destroy(struct object *o)
 {
 	struct goat3d_mesh *m;
 
+	if(o->arena) return;	/* released with the arena */
+
+	if(o->name != o->defname) {
+		g3dimpl_free(o->name);
+	}
+
 	switch(o->type) {
 	case OBJTYPE_MESH:
 		m = (struct goat3d_mesh*)o;
@@ -99,6 +110,7 @@ void g3dimpl_obj_destroy(struct object *o)
 		dynarr_free(m->colors);
 		dynarr_free(m->faces);
 		dynarr_free(m->bones);
+		dynarr_free(m->bone_invbind);
 		break;
 
 	default:
@@ -106,6 +118,21 @@ void g3dimpl_obj_destroy(struct object *o)
 	}
 }
 
+/* pushes a vertex attribute, presizing the array on the first push to the
+ * number of vertices reserved by goat3d_reserve_mesh
+ */
+void *g3dimpl_mesh_push_vattr(struct goat3d_mesh *mesh, void *arr, void *item)
+{
+	void *tmp;
+
+	if(dynarr_empty(arr) && dynarr_capacity(arr) < mesh->reserved_verts) {
+		if((tmp = dynarr_reserve(arr, mesh->reserved_verts))) {
+			arr = tmp;
+		}
+	}
+	return dynarr_push(arr, item);
+}
+
 void g3dimpl_mesh_bounds(struct aabox *bb, struct goat3d_mesh *m, float *xform)
 {
 	int i, nverts;
@@ -127,66 +154,90 @@ void g3dimpl_mesh_bounds(struct aabox *bb, struct goat3d_mesh *m, float *xform)
 	}
 }
 
-int g3dimpl_mtl_init(struct goat3d_material *mtl)
+int g3dimpl_mtl_init(struct goat3d_material *mtl, struct arena *arena)
 {
+	int i;
+
 	memset(mtl, 0, sizeof *mtl);
-	if(!(mtl->attrib = dynarr_alloc(0, sizeof *mtl->attrib))) {
+	if(!(mtl->attrib = dynarr_alloc_arena(0, sizeof *mtl->attrib, arena))) {
 		return -1;
 	}
+	for(i=0; i<NUM_GOAT3D_PREDEF_ATOMS; i++) {
+		mtl->attr_slot[i] = -1;
+	}
+	mtl->arena = arena;
 	return 0;
 }
 
 void g3dimpl_mtl_destroy(struct goat3d_material *mtl)
 {
-	int i, num = dynarr_size(mtl->attrib);
+	int i, num;
+
+	if(mtl->arena) return;	/* released with the arena */
+
+	num = dynarr_size(mtl->attrib);
 	for(i=0; i<num; i++) {
-		free(mtl->attrib[i].name);
-		free(mtl->attrib[i].map);
+		g3dimpl_free(mtl->attrib[i].map);
 	}
 	dynarr_free(mtl->attrib);
 }
 
 struct material_attrib *g3dimpl_mtl_findattr(struct goat3d_material *mtl, const char *name)
 {
-	int i, num = dynarr_size(mtl->attrib);
+	int atom = g3dimpl_find_atom(name);
+	return atom == -1 ? 0 : g3dimpl_mtl_findattr_atom(mtl, atom);
+}
+
+struct material_attrib *g3dimpl_mtl_getattr(struct goat3d_material *mtl, const char *name)
+{
+	int atom = goat3d_atom(name);
+	return atom == -1 ? 0 : g3dimpl_mtl_getattr_atom(mtl, atom);
+}
 
+struct material_attrib *g3dimpl_mtl_findattr_atom(struct goat3d_material *mtl, int atom)
+{
+	int i, num;
+
+	if(atom >= 0 && atom < NUM_GOAT3D_PREDEF_ATOMS) {
+		i = mtl->attr_slot[atom];
+		return i >= 0 ? mtl->attrib + i : 0;
+	}
+
+	num = dynarr_size(mtl->attrib);
 	for(i=0; i<num; i++) {
-		if(strcmp(mtl->attrib[i].name, name) == 0) {
+		if(mtl->attrib[i].atom == atom) {
 			return mtl->attrib + i;
 		}
 	}
 	return 0;
 }
 
-struct material_attrib *g3dimpl_mtl_getattr(struct goat3d_material *mtl, const char *name)
+struct material_attrib *g3dimpl_mtl_getattr_atom(struct goat3d_material *mtl, int atom)
 {
-	int idx, len;
-	char *tmpname;
-	struct material_attrib *tmpattr, *ma;
+	int idx;
+	struct material_attrib *tmpattr, *ma, attr;
 
-	if((ma = g3dimpl_mtl_findattr(mtl, name))) {
+	if((ma = g3dimpl_mtl_findattr_atom(mtl, atom))) {
 		return ma;
 	}
-
-	len = strlen(name);
-	if(!(tmpname = malloc(len + 1))) {
+	if(!(attr.name = goat3d_atom_name(atom))) {
 		return 0;
 	}
-	memcpy(tmpname, name, len + 1);
+	attr.atom = atom;
+	attr.map = 0;
+	cgm_wcons(&attr.value, 1, 1, 1, 1);
 
 	idx = dynarr_size(mtl->attrib);
-	if(!(tmpattr = dynarr_push(mtl->attrib, 0))) {
-		free(tmpname);
+	tmpattr = dynarr_push(mtl->attrib, &attr);
+	if(dynarr_size(tmpattr) <= idx) {
 		return 0;
 	}
 	mtl->attrib = tmpattr;
 
-	ma = mtl->attrib + idx;
-	ma->name = tmpname;
-	ma->map = 0;
-	cgm_wcons(&ma->value, 1, 1, 1, 1);
-
-	return ma;
+	if(atom < NUM_GOAT3D_PREDEF_ATOMS) {
+		mtl->attr_slot[atom] = idx;
+	}
+	return mtl->attrib + idx;
 }
 
 void g3dimpl_node_bounds(struct aabox *bb, struct anm_node *n)
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <anim/anim.h>
 #include "goat3d.h"
 #include "aabox.h"
+#include "arena.h"
 
 enum {
 	OBJTYPE_UNKNOWN,
@@ -51,7 +52,8 @@ typedef struct int4 {
 } int4;
 
 struct material_attrib {
-	char *name;
+	const char *name;	/* interned, see goat3d_atom */
+	int atom;
 	cgm_vec4 value;
 	char *map;
 };
@@ -59,15 +61,21 @@ struct material_attrib {
 struct goat3d_material {
 	char *name;
 	struct material_attrib *attrib;	/* dynarr */
+	/* index in attrib of each predefined attribute atom, -1 if missing */
+	int attr_slot[NUM_GOAT3D_PREDEF_ATOMS];
+	struct arena *arena;	/* non-null if owned by a scene arena */
 };
 
 
+/* name points to defname, until the object is renamed */
 #define OBJECT_COMMON	\
 	int type; \
 	char *name; \
+	char defname[20]; \
 	cgm_vec3 pos; \
 	cgm_quat rot; \
 	cgm_vec3 scale; \
+	struct arena *arena; \
 	void *next
 
 struct object {
@@ -88,6 +96,9 @@ struct goat3d_mesh {
 	cgm_vec4 *colors;
 	struct face *faces;
 	struct anm_node **bones;
+	float *bone_invbind;	/* inverse bind pose matrix of each bone, 16 floats each */
+
+	int reserved_verts;		/* see goat3d_reserve_mesh */
 };
 
 struct goat3d_light {
@@ -113,17 +124,29 @@ struct goat3d_node {
 	enum goat3d_node_type type;
 	void *obj;
 	int child_count;
+
+	/* last key interval sampled in each track of the active animation */
+	int key_cursor[ANM_NUM_TRACKS];
 };
 
-int g3dimpl_obj_init(struct object *o, int type);
+/* objects and materials initialized with a non-null arena allocate all their
+ * data from it, and are released all at once when the arena is cleared.
+ */
+int g3dimpl_obj_init(struct object *o, int type, struct arena *arena);
 void g3dimpl_obj_destroy(struct object *o);
 
 void g3dimpl_mesh_bounds(struct aabox *bb, struct goat3d_mesh *m, float *xform);
+void *g3dimpl_mesh_push_vattr(struct goat3d_mesh *m, void *arr, void *item);
+
+int g3dimpl_mesh_add_bone(struct goat3d_mesh *m, struct anm_node *bone, const float *invbind);
+int g3dimpl_skin_mesh(struct goat3d_mesh *m, long tmsec, float *pos, float *norm);
 
-int g3dimpl_mtl_init(struct goat3d_material *mtl);
+int g3dimpl_mtl_init(struct goat3d_material *mtl, struct arena *arena);
 void g3dimpl_mtl_destroy(struct goat3d_material *mtl);
 struct material_attrib *g3dimpl_mtl_findattr(struct goat3d_material *mtl, const char *name);
 struct material_attrib *g3dimpl_mtl_getattr(struct goat3d_material *mtl, const char *name);
+struct material_attrib *g3dimpl_mtl_findattr_atom(struct goat3d_material *mtl, int atom);
+struct material_attrib *g3dimpl_mtl_getattr_atom(struct goat3d_material *mtl, int atom);
 
 void g3dimpl_node_bounds(struct aabox *bb, struct anm_node *n);
 
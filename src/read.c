@@ -15,35 +15,200 @@ GNU Lesser General Public License for more details.
 You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include <assert.h>
 #include <treestore.h>
 #include "goat3d.h"
 #include "goat3d_impl.h"
 #include "log.h"
 #include "dynarr.h"
-
-struct key {
-	long tm;
-	cgm_vec4 val;
-};
+#include "g3danm.h"
+#include "bufio.h"
+#include "summary.h"
 
 static struct goat3d_material *read_material(struct goat3d *g, struct ts_node *tsmtl);
-static char *read_material_attrib(struct material_attrib *attr, struct ts_node *tsmattr);
+static int read_material_attrib(struct goat3d_material *mtl, struct ts_node *tsmattr);
 struct goat3d_mesh *read_mesh(struct goat3d *g, struct ts_node *tsmesh);
+static int read_track(struct goat3d *g, struct ts_node *tstrk);
+static int scnload_stream(struct goat3d *g, struct goat3d_io *io, const void *hdr,
+		size_t hdrsz, size_t skip, int check);
+static int read_scene(struct goat3d *g, struct ts_node *tsroot);
+
+struct memreader {
+	const char *buf;
+	size_t size, pos;
+};
+
+static long read_mem(void *buf, size_t bytes, void *uptr);
+static long write_mem(const void *buf, size_t bytes, void *uptr);
 
+/* binary scenes, which start with a summary block, are streamed to treestore.
+ * Anything else is read into memory whole, in large blocks, to be handed to
+ * the text scene parser, or the generic treestore loader if it's not a text
+ * scene file.
+ */
 int g3dimpl_scnload(struct goat3d *g, struct goat3d_io *io)
 {
+	int res, peeked = 0;
+	char *buf = 0, *tmp;
+	size_t size = 0, max = 0, blksz, skip;
+	unsigned int flags;
+	long rd;
+
+	if((blksz = goat3d_get_io_block_size()) < 65536) {
+		blksz = 65536;
+	}
+
+	for(;;) {
+		if(!peeked && size >= SUMMARY_MIN) {
+			peeked = 1;
+			if((skip = g3dimpl_read_summary(buf, size, 0, &flags)) > 0) {
+				res = scnload_stream(g, io, buf, size, skip, flags & SUMMARY_CRC);
+				g3dimpl_free(buf);
+				return res;
+			}
+		}
+		if(max - size < blksz) {
+			max = max ? max * 2 : blksz;
+			if(!(tmp = g3dimpl_realloc(buf, max))) {
+				goat3d_logmsg(LOG_ERROR, "failed to allocate %lu bytes for loading the scene\n",
+						(unsigned long)max);
+				g3dimpl_free(buf);
+				return -1;
+			}
+			buf = tmp;
+		}
+		if((rd = io->read(buf + size, max - size, io->cls)) <= 0) {
+			break;
+		}
+		size += rd;
+	}
+	if(rd < 0) {
+		goat3d_logmsg(LOG_ERROR, "failed to load scene: read error\n");
+		g3dimpl_free(buf);
+		return -1;
+	}
+
+	res = g3dimpl_scnload_mem(g, buf, size);
+	g3dimpl_free(buf);
+	return res;
+}
+
+int g3dimpl_scnload_mem(struct goat3d *g, const void *buf, size_t size)
+{
+	int res;
+	size_t skip;
+	unsigned int flags;
 	struct ts_io tsio;
-	struct ts_node *tsroot, *c;
+	struct memreader mr;
+
+	/* binary scenes start with a summary block, which isn't needed here, and
+	 * end with a checksum, which is cheap compared to parsing
+	 */
+	if((skip = g3dimpl_read_summary(buf, size, 0, &flags)) > 0) {
+		if(flags & SUMMARY_CRC) {
+			if(g3dimpl_check_trailer(buf, size) == -1) {
+				goat3d_logmsg(LOG_ERROR, "failed to load scene\n");
+				return -1;
+			}
+			size -= TRAILER_SIZE;
+		}
+		if(skip > size) {
+			goat3d_logmsg(LOG_ERROR, "failed to load scene: truncated file\n");
+			return -1;
+		}
+		buf = (const char*)buf + skip;
+		size -= skip;
+	}
+
+	if((res = g3dimpl_scnload_text(g, buf, size)) != 1) {
+		return res;
+	}
+
+	mr.buf = buf;
+	mr.size = size;
+	mr.pos = 0;
+
+	tsio.data = &mr;
+	tsio.read = read_mem;
+	tsio.write = write_mem;
+	return g3dimpl_scnload_tsio(g, &tsio);
+}
+
+static long read_mem(void *buf, size_t bytes, void *uptr)
+{
+	struct memreader *mr = uptr;
+
+	if(bytes > mr->size - mr->pos) {
+		bytes = mr->size - mr->pos;
+	}
+	memcpy(buf, mr->buf + mr->pos, bytes);
+	mr->pos += bytes;
+	return (long)bytes;
+}
+
+static long write_mem(const void *buf, size_t bytes, void *uptr)
+{
+	return -1;
+}
+
+/* the tree is only turned into scene objects after the checksum is checked,
+ * so a corrupted file doesn't add anything to the scene
+ */
+static int scnload_stream(struct goat3d *g, struct goat3d_io *io, const void *hdr,
+		size_t hdrsz, size_t skip, int check)
+{
+	char tmp[256];
+	long rd;
+	struct crcreader cr;
+	struct ts_io tsio;
+	struct ts_node *tsroot;
 
-	tsio.data = io->cls;
-	tsio.read = io->read;
-	tsio.write = io->write;
+	if(g3dimpl_crcreader_open(&cr, io, check, hdr, hdrsz) == -1) {
+		return -1;
+	}
 
-	if(!(tsroot = ts_load_io(&tsio))) {
+	/* the summary block isn't needed here, but it's covered by the checksum */
+	while(skip > 0) {
+		if((rd = g3dimpl_crcreader_read(tmp, skip < sizeof tmp ? skip : sizeof tmp, &cr)) <= 0) {
+			break;
+		}
+		skip -= rd;
+	}
+
+	tsio.data = &cr;
+	tsio.read = g3dimpl_crcreader_read;
+	tsio.write = write_mem;
+	tsroot = skip ? 0 : ts_load_io(&tsio);
+
+	if(g3dimpl_crcreader_close(&cr) == -1) {
+		if(tsroot) ts_free_tree(tsroot);
 		goat3d_logmsg(LOG_ERROR, "failed to load scene\n");
 		return -1;
 	}
+	if(!tsroot) {
+		goat3d_logmsg(LOG_ERROR, "failed to load scene\n");
+		return -1;
+	}
+	return read_scene(g, tsroot);
+}
+
+int g3dimpl_scnload_tsio(struct goat3d *g, struct ts_io *tsio)
+{
+	struct ts_node *tsroot;
+
+	if(!(tsroot = ts_load_io(tsio))) {
+		goat3d_logmsg(LOG_ERROR, "failed to load scene\n");
+		return -1;
+	}
+	return read_scene(g, tsroot);
+}
+
+/* adds the contents of a scene tree to g, and frees the tree */
+static int read_scene(struct goat3d *g, struct ts_node *tsroot)
+{
+	struct ts_node *c;
+
 	if(strcmp(tsroot->name, "scene") != 0) {
 		goat3d_logmsg(LOG_ERROR, "invalid scene file, root node is not \"scene\"\n");
 		ts_free_tree(tsroot);
@@ -58,6 +223,7 @@ int g3dimpl_scnload(struct goat3d *g, struct goat3d_io *io)
 			if(mtl) {
 				goat3d_add_mtl(g, mtl);
 			}
+			if(g3dimpl_load_progress(g) == -1) goto cancel;
 		}
 		c = c->next;
 	}
@@ -70,6 +236,7 @@ int g3dimpl_scnload(struct goat3d *g, struct goat3d_io *io)
 			if(mesh) {
 				goat3d_add_mesh(g, mesh);
 			}
+			if(g3dimpl_load_progress(g) == -1) goto cancel;
 		}
 		c = c->next;
 	}
@@ -79,34 +246,80 @@ int g3dimpl_scnload(struct goat3d *g, struct goat3d_io *io)
 
 	ts_free_tree(tsroot);
 	return 0;
+
+cancel:
+	ts_free_tree(tsroot);
+	return -1;
 }
 
 int g3dimpl_anmload(struct goat3d *g, struct goat3d_io *io)
 {
-	/*
+	int i, num;
 	struct ts_io tsio;
-	tsio.data = io->cls;
-	tsio.read = io->read;
-	tsio.write = io->write;
-	*/
-	return -1;
+	struct bufio bio;
+	struct ts_node *tsroot, *c;
+	const char *name;
+
+	g3dimpl_bufio_open(&bio, io);
+	tsio.data = &bio;
+	tsio.read = g3dimpl_bufio_read;
+	tsio.write = g3dimpl_bufio_write;
+
+	tsroot = ts_load_io(&tsio);
+	g3dimpl_bufio_close(&bio);
+	if(!tsroot) {
+		goat3d_logmsg(LOG_ERROR, "failed to load animation\n");
+		return -1;
+	}
+	if(strcmp(tsroot->name, "anim") != 0) {
+		goat3d_logmsg(LOG_ERROR, "invalid animation file, root node is not \"anim\"\n");
+		ts_free_tree(tsroot);
+		return -1;
+	}
+
+	/* add a new animation to every node hierarchy, and make it active */
+	name = ts_get_attr_str(tsroot, "name", 0);
+	num = dynarr_size(g->nodes);
+	for(i=0; i<num; i++) {
+		struct goat3d_node *node = g->nodes[i];
+		if(node->anm.parent) continue;
+
+		goat3d_add_anim(node);
+		if(name) {
+			goat3d_set_anim_name(node, name);
+		}
+	}
+
+	c = tsroot->child_list;
+	while(c) {
+		if(strcmp(c->name, "track") == 0) {
+			read_track(g, c);
+			if(g3dimpl_load_progress(g) == -1) break;
+		}
+		c = c->next;
+	}
+
+	ts_free_tree(tsroot);
+	return c ? -1 : 0;
 }
 
 static struct goat3d_material *read_material(struct goat3d *g, struct ts_node *tsmtl)
 {
 	struct goat3d_material *mtl;
-	struct material_attrib mattr, *arr;
 	struct ts_node *c;
 	const char *str;
 
-	if(!(mtl = malloc(sizeof *mtl)) || g3dimpl_mtl_init(mtl) == -1) {
+	if(!(mtl = g3dimpl_arena_alloc(g->arena, sizeof *mtl)) || g3dimpl_mtl_init(mtl, g->arena) == -1) {
 		goat3d_logmsg(LOG_ERROR, "read_material: failed to allocate material\n");
 		return 0;
 	}
 
 	if(!(str = ts_get_attr_str(tsmtl, "name", 0)) || !*str) {
 		goat3d_logmsg(LOG_WARNING, "read_material: ignoring material without a name\n");
-		g3dimpl_mtl_destroy(mtl);
+		return 0;
+	}
+	if(goat3d_set_mtl_name(mtl, str) == -1) {
+		goat3d_logmsg(LOG_ERROR, "read_material: failed to allocate material name\n");
 		return 0;
 	}
 
@@ -114,73 +327,174 @@ static struct goat3d_material *read_material(struct goat3d *g, struct ts_node *t
 	c = tsmtl->child_list;
 	while(c) {
 		if(strcmp(c->name, "attr") == 0) {
-			if(read_material_attrib(&mattr, c)) {
-				if(!(arr = dynarr_push(mtl->attrib, &mattr))) {
-					goat3d_logmsg(LOG_ERROR, "read_material: failed to resize material attribute array\n");
-					g3dimpl_mtl_destroy(mtl);
-					return 0;
-				}
-				mtl->attrib = arr;
-			}
+			read_material_attrib(mtl, c);
 		}
 		c = c->next;
 	}
 
 	if(dynarr_empty(mtl->attrib)) {
 		goat3d_logmsg(LOG_WARNING, "read_material: ignoring empty material: %s\n", mtl->name);
-		g3dimpl_mtl_destroy(mtl);
 		return 0;
 	}
 	return mtl;
 }
 
-static char *read_material_attrib(struct material_attrib *attr, struct ts_node *tsnode)
+static int read_material_attrib(struct goat3d_material *mtl, struct ts_node *tsnode)
 {
 	int i;
 	struct ts_attr *tsattr;
 	const char *name, *map;
-
-	memset(attr, 0, sizeof *attr);
+	struct material_attrib *attr;
+	cgm_vec4 value = {0, 0, 0, 0};
 
 	if((tsattr = ts_get_attr(tsnode, "val"))) {
-		attr->value.w = 1.0f;	/* default W to 1 if we get less than a float4 */
+		value.w = 1.0f;	/* default W to 1 if we get less than a float4 */
 
 		switch(tsattr->val.type) {
 		case TS_NUMBER:
-			attr->value.x = tsattr->val.fnum;
+			value.x = tsattr->val.fnum;
 			break;
 		case TS_VECTOR:
 			assert(tsattr->val.vec_size <= 4);
 			for(i=0; i<tsattr->val.vec_size; i++) {
-				(&attr->value.x)[i] = tsattr->val.vec[i];
+				(&value.x)[i] = tsattr->val.vec[i];
 			}
 			break;
 		default: /* no valid val attribute found */
-			return 0;
+			return -1;
 		}
 	}
 
 	if(!(name = ts_get_attr_str(tsnode, "name", 0)) || !*name) {
-		return 0;
+		return -1;
 	}
-	if(!(attr->name = malloc(strlen(name) + 1))) {
-		goat3d_logmsg(LOG_ERROR, "read_material_attrib: failed to allocate name\n");
-		return 0;
+	if(!(attr = g3dimpl_mtl_getattr(mtl, name))) {
+		goat3d_logmsg(LOG_ERROR, "read_material_attrib: failed to add attribute: %s\n", name);
+		return -1;
 	}
-	strcpy(attr->name, name);
+	attr->value = value;
 
 	if((map = ts_get_attr_str(tsnode, "map", 0)) && *map) {
-		if(!(attr->map = malloc(strlen(map) + 1))) {
+		if(!(attr->map = g3dimpl_astrdup(mtl->arena, map))) {
 			goat3d_logmsg(LOG_ERROR, "read_material_attrib: failed to allocate map name\n");
-			free(attr->name);
-			return 0;
+			return -1;
 		}
-		strcpy(attr->map, map);
 	}
-	return attr->name;
+	return 0;
 }
 
 struct goat3d_mesh *read_mesh(struct goat3d *g, struct ts_node *tsmesh)
 {
 	return 0;	/* TODO */
 }
+
+static int read_track(struct goat3d *g, struct ts_node *tstrk)
+{
+	int i, j, attr, num, rot, interp, extrap;
+	const char *str;
+	struct goat3d_node *node;
+	struct anm_animation *anim;
+	struct key *keys;
+	struct ts_node *c;
+	struct ts_attr *tsattr;
+	float *vec;
+	cgm_vec3 vmin, vmax;
+
+	if(!(str = ts_get_attr_str(tstrk, "node", 0)) || !(node = goat3d_get_node_by_name(g, str))) {
+		goat3d_logmsg(LOG_WARNING, "read_track: ignoring track for missing node: %s\n", str ? str : "<unnamed>");
+		return -1;
+	}
+	if(!(str = ts_get_attr_str(tstrk, "attr", 0)) || (attr = g3dimpl_find_name(g3dimpl_track_attr_names, str)) == -1) {
+		goat3d_logmsg(LOG_WARNING, "read_track: ignoring track with unknown attribute: %s\n", str ? str : "<none>");
+		return -1;
+	}
+	rot = attr == ROTATION_TRACK;
+
+	if((str = ts_get_attr_str(tstrk, "keys", 0))) {
+		/* compressed track, see doc/goatanimfmt */
+		if((num = ts_get_attr_int(tstrk, "key-count", 0)) <= 0) {
+			return 0;
+		}
+		/* don't trust key-count with the allocation below, the packed keys
+		 * take 10 bytes each, 3 bytes per 4 base64 characters
+		 */
+		if((size_t)num > strlen(str) / 4 * 3 / 10) goto inval;
+		if(!rot) {
+			if(!(vec = ts_get_attr_vec(tstrk, "range-min", 0))) goto inval;
+			cgm_vcons(&vmin, vec[0], vec[1], vec[2]);
+			if(!(vec = ts_get_attr_vec(tstrk, "range-max", 0))) goto inval;
+			cgm_vcons(&vmax, vec[0], vec[1], vec[2]);
+		}
+		if(!(keys = g3dimpl_malloc(num * sizeof *keys))) {
+			goat3d_logmsg(LOG_ERROR, "read_track: failed to allocate keyframe array\n");
+			return -1;
+		}
+		if(g3dimpl_unpack_keys(keys, num, str, rot, &vmin, &vmax) == -1) {
+			g3dimpl_free(keys);
+			goto inval;
+		}
+
+	} else {
+		num = 0;
+		c = tstrk->child_list;
+		while(c) {
+			if(strcmp(c->name, "key") == 0) num++;
+			c = c->next;
+		}
+		if(!num) return 0;
+
+		if(!(keys = g3dimpl_malloc(num * sizeof *keys))) {
+			goat3d_logmsg(LOG_ERROR, "read_track: failed to allocate keyframe array\n");
+			return -1;
+		}
+
+		i = 0;
+		c = tstrk->child_list;
+		while(c) {
+			if(strcmp(c->name, "key") == 0) {
+				keys[i].tm = ts_get_attr_int(c, "time", 0);
+				cgm_wcons(&keys[i].val, 0, 0, 0, 1);
+				if((tsattr = ts_get_attr(c, "value")) && tsattr->val.type == TS_VECTOR) {
+					for(j=0; j<tsattr->val.vec_size && j<4; j++) {
+						(&keys[i].val.x)[j] = tsattr->val.vec[j];
+					}
+				}
+				i++;
+			}
+			c = c->next;
+		}
+	}
+
+	for(i=0; i<num; i++) {
+		cgm_vec4 *v = &keys[i].val;
+		switch(attr) {
+		case POSITION_TRACK:
+			goat3d_set_node_position(node, v->x, v->y, v->z, keys[i].tm);
+			break;
+		case ROTATION_TRACK:
+			goat3d_set_node_rotation(node, v->x, v->y, v->z, v->w, keys[i].tm);
+			break;
+		default:
+			goat3d_set_node_scaling(node, v->x, v->y, v->z, keys[i].tm);
+		}
+	}
+	g3dimpl_free(keys);
+
+	if((anim = anm_get_active_animation(&node->anm, 0))) {
+		str = ts_get_attr_str(tstrk, "interp", 0);
+		interp = str ? g3dimpl_find_name(g3dimpl_interp_names, str) : -1;
+		str = ts_get_attr_str(tstrk, "extrap", 0);
+		extrap = str ? g3dimpl_find_name(g3dimpl_extrap_names, str) : -1;
+
+		for(i=0; i<g3dimpl_track_nelem[attr]; i++) {
+			struct anm_track *trk = anim->tracks + g3dimpl_track_base[attr] + i;
+			if(interp >= 0) anm_set_track_interpolator(trk, interp);
+			if(extrap >= 0) anm_set_track_extrapolator(trk, extrap);
+		}
+	}
+	return 0;
+
+inval:
+	goat3d_logmsg(LOG_WARNING, "read_track: ignoring invalid compressed track\n");
+	return -1;
+}
@@ -0,0 +1,196 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "object.h"
+#include "dynarr.h"
+#include "g3danm.h"
+#include "tpool.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* number of vertices skinned by each parallel job */
+#define SKIN_BLOCK	512
+
+struct skin_context {
+	const struct goat3d_mesh *mesh;
+	const float *palette;
+	int num_bones, num_verts;
+	float *pos, *norm;
+};
+
+static void skin_block(int idx, void *cls);
+
+int g3dimpl_mesh_add_bone(struct goat3d_mesh *m, struct anm_node *bone, const float *invbind)
+{
+	float mat[16];
+	void *tmp;
+
+	if(invbind) {
+		memcpy(mat, invbind, sizeof mat);
+	} else {
+		anm_get_matrix(bone, mat, 0);
+		if(cgm_minverse(mat) == -1) {
+			return -1;
+		}
+	}
+
+	if(!(tmp = dynarr_push(m->bone_invbind, mat))) {
+		return -1;
+	}
+	m->bone_invbind = tmp;
+
+	if(!(tmp = dynarr_push(m->bones, &bone))) {
+		DYNARR_POP(m->bone_invbind);
+		return -1;
+	}
+	m->bones = tmp;
+	return 0;
+}
+
+int g3dimpl_skin_mesh(struct goat3d_mesh *m, long tmsec, float *pos, float *norm)
+{
+	int i, num_bones;
+	float *palette, world[16];
+	anm_time_t tm = ANM_MSEC2TM(tmsec);
+	struct skin_context ctx;
+
+	/* bone matrix palette: current bone world matrix * inverse bind pose */
+	num_bones = dynarr_size(m->bones);
+	if(!(palette = g3dimpl_malloc(num_bones * 16 * sizeof *palette))) {
+		return -1;
+	}
+	for(i=0; i<num_bones; i++) {
+		anm_get_matrix(m->bones[i], world, tm);
+		g3dimpl_mat_mul(palette + i * 16, world, m->bone_invbind + i * 16);
+	}
+
+	ctx.mesh = m;
+	ctx.palette = palette;
+	ctx.num_bones = num_bones;
+	ctx.num_verts = dynarr_size(m->vertices);
+	ctx.pos = pos;
+	ctx.norm = dynarr_size(m->normals) == ctx.num_verts ? norm : 0;
+
+	g3dimpl_parallel_for((ctx.num_verts + SKIN_BLOCK - 1) / SKIN_BLOCK, skin_block, &ctx);
+
+	g3dimpl_free(palette);
+	return 0;
+}
+
+static void skin_block(int idx, void *cls)
+{
+	int i, j, start, end, bidx;
+	struct skin_context *ctx = cls;
+	const struct goat3d_mesh *m = ctx->mesh;
+	const float *mat, *wptr;
+	const int *iptr;
+	const cgm_vec3 *v, *n;
+	float *dest, len;
+#ifdef __SSE__
+	__m128 c0, c1, c2, c3, w, res;
+	float tmp[4];
+#else
+	int k;
+	float bm[12];
+#endif
+
+	start = idx * SKIN_BLOCK;
+	end = start + SKIN_BLOCK;
+	if(end > ctx->num_verts) end = ctx->num_verts;
+
+	for(i=start; i<end; i++) {
+		wptr = &m->skin_weights[i].x;
+		iptr = &m->skin_matrices[i].x;
+		v = m->vertices + i;
+
+#ifdef __SSE__
+		/* blend the 3x4 upper part of the bone matrices, one column per register */
+		c0 = c1 = c2 = c3 = _mm_setzero_ps();
+		for(j=0; j<4; j++) {
+			bidx = iptr[j];
+			if(wptr[j] == 0.0f || bidx < 0 || bidx >= ctx->num_bones) continue;
+			mat = ctx->palette + bidx * 16;
+			w = _mm_set1_ps(wptr[j]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(mat)));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(mat + 4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(mat + 8)));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(mat + 12)));
+		}
+
+		res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v->x)),
+					_mm_mul_ps(c1, _mm_set1_ps(v->y))),
+				_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v->z)), c3));
+		_mm_storeu_ps(tmp, res);
+		dest = ctx->pos + i * 3;
+		dest[0] = tmp[0];
+		dest[1] = tmp[1];
+		dest[2] = tmp[2];
+
+		if(ctx->norm) {
+			n = m->normals + i;
+			res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n->x)),
+						_mm_mul_ps(c1, _mm_set1_ps(n->y))),
+					_mm_mul_ps(c2, _mm_set1_ps(n->z)));
+			_mm_storeu_ps(tmp, res);
+			dest = ctx->norm + i * 3;
+			len = sqrt(tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2]);
+			if(len > 0.0f) len = 1.0f / len;
+			dest[0] = tmp[0] * len;
+			dest[1] = tmp[1] * len;
+			dest[2] = tmp[2] * len;
+		}
+#else
+		memset(bm, 0, sizeof bm);
+		for(j=0; j<4; j++) {
+			bidx = iptr[j];
+			if(wptr[j] == 0.0f || bidx < 0 || bidx >= ctx->num_bones) continue;
+			mat = ctx->palette + bidx * 16;
+			for(k=0; k<3; k++) {
+				bm[k] += wptr[j] * mat[k];
+				bm[k + 3] += wptr[j] * mat[k + 4];
+				bm[k + 6] += wptr[j] * mat[k + 8];
+				bm[k + 9] += wptr[j] * mat[k + 12];
+			}
+		}
+
+		dest = ctx->pos + i * 3;
+		for(k=0; k<3; k++) {
+			dest[k] = bm[k] * v->x + bm[k + 3] * v->y + bm[k + 6] * v->z + bm[k + 9];
+		}
+
+		if(ctx->norm) {
+			n = m->normals + i;
+			dest = ctx->norm + i * 3;
+			for(k=0; k<3; k++) {
+				dest[k] = bm[k] * n->x + bm[k + 3] * n->y + bm[k + 6] * n->z;
+			}
+			len = sqrt(dest[0] * dest[0] + dest[1] * dest[1] + dest[2] * dest[2]);
+			if(len > 0.0f) {
+				len = 1.0f / len;
+				dest[0] *= len;
+				dest[1] *= len;
+				dest[2] *= len;
+			}
+		}
+#endif
+	}
+}
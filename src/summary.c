@@ -0,0 +1,454 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <treestore.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "summary.h"
+#include "alloc.h"
+#include "dynarr.h"
+#include "log.h"
+
+/* the summary block is little endian, laid out as follows (byte offsets):
+ *   0 magic "G3DS"       4 version (16bit)   6 block size (16bit)
+ *   8 material count    12 mesh count       16 light count
+ *  20 camera count      24 node count       28 content hash
+ *  32 vertex count (64bit)                  40 face count (64bit)
+ *  48 bounds min xyz    60 bounds max xyz
+ *  72 animation start (64bit)               80 animation end (64bit)
+ *  88 flags (SUMMARY_CRC)                  92 reserved, zero
+ * Newer versions may only append fields, readers skip the whole block using
+ * its size. SUMMARY_MIN is the size of the version 1 fields.
+ */
+#define SUMMARY_MAGIC	"G3DS"
+#define SUMMARY_VER		1
+#define SUMMARY_SIZE	128
+#define TRAILER_MAGIC	"G3DC"
+#define VERIFY_BUF_SIZE	65536
+
+static void put32(unsigned char *p, uint32_t x);
+static void put64(unsigned char *p, uint64_t x);
+static void putf(unsigned char *p, float x);
+static uint32_t get32(const unsigned char *p);
+static uint64_t get64(const unsigned char *p);
+static float getf(const unsigned char *p);
+static uint32_t mesh_hash(uint32_t crc, const struct goat3d_mesh *mesh);
+static size_t crc_avail(const struct crcreader *cr);
+static long crc_refill(struct crcreader *cr);
+
+
+GOAT3DAPI void goat3d_get_summary(const struct goat3d *g, struct goat3d_summary *sum)
+{
+	int i;
+	long tstart, tend;
+	struct aabox bbox, mesh_bbox;
+	struct goat3d_mesh *mesh;
+
+	memset(sum, 0, sizeof *sum);
+	sum->num_mtls = dynarr_size(g->materials);
+	sum->num_meshes = dynarr_size(g->meshes);
+	sum->num_lights = dynarr_size(g->lights);
+	sum->num_cameras = dynarr_size(g->cameras);
+	sum->num_nodes = dynarr_size(g->nodes);
+
+	g3dimpl_aabox_init(&bbox);
+	for(i=0; i<sum->num_meshes; i++) {
+		mesh = g->meshes[i];
+		sum->num_verts += dynarr_size(mesh->vertices);
+		sum->num_faces += dynarr_size(mesh->faces);
+		sum->hash = mesh_hash(sum->hash, mesh);
+
+		/* without nodes placing them, the scene bounds are the mesh bounds */
+		if(!sum->num_nodes) {
+			g3dimpl_mesh_bounds(&mesh_bbox, mesh, 0);
+			g3dimpl_aabox_union(&bbox, &bbox, &mesh_bbox);
+		}
+	}
+	if(sum->num_nodes) {
+		goat3d_get_bounds(g, sum->bmin, sum->bmax);
+	} else {
+		sum->bmin[0] = bbox.bmin.x;
+		sum->bmin[1] = bbox.bmin.y;
+		sum->bmin[2] = bbox.bmin.z;
+		sum->bmax[0] = bbox.bmax.x;
+		sum->bmax[1] = bbox.bmax.y;
+		sum->bmax[2] = bbox.bmax.z;
+	}
+
+	sum->tstart = LONG_MAX;
+	sum->tend = LONG_MIN;
+	for(i=0; i<sum->num_nodes; i++) {
+		if(g->nodes[i]->anm.parent) continue;
+		if(goat3d_get_anim_timeline(g->nodes[i], &tstart, &tend) >= 0) {
+			if(tstart < sum->tstart) sum->tstart = tstart;
+			if(tend > sum->tend) sum->tend = tend;
+		}
+	}
+	if(sum->tstart > sum->tend) {
+		sum->tstart = sum->tend = 0;
+	} else {
+		sum->anim = 1;
+	}
+}
+
+GOAT3DAPI int goat3d_peek(const char *fname, struct goat3d_summary *sum)
+{
+	int res;
+	FILE *fp;
+
+	if(!(fp = fopen(fname, "rb"))) {
+		goat3d_logmsg(LOG_ERROR, "failed to open file \"%s\" for reading: %s\n", fname, strerror(errno));
+		return -1;
+	}
+	res = goat3d_peek_file(fp, sum);
+	fclose(fp);
+	return res;
+}
+
+GOAT3DAPI int goat3d_peek_file(FILE *fp, struct goat3d_summary *sum)
+{
+	unsigned char buf[SUMMARY_SIZE];
+	size_t sz;
+
+	sz = fread(buf, 1, SUMMARY_MIN, fp);
+	if(ferror(fp)) {
+		goat3d_logmsg(LOG_ERROR, "goat3d_peek: read error\n");
+		return -1;
+	}
+	return g3dimpl_read_summary(buf, sz, sum, 0) > 0 ? 0 : 1;
+}
+
+/* writes the summary block ahead of a binary scene */
+int g3dimpl_write_summary(const struct goat3d *g, struct ts_io *tsio)
+{
+	int i;
+	unsigned char buf[SUMMARY_SIZE];
+	struct goat3d_summary sum;
+
+	goat3d_get_summary(g, &sum);
+
+	memset(buf, 0, sizeof buf);
+	memcpy(buf, SUMMARY_MAGIC, 4);
+	buf[4] = SUMMARY_VER;
+	buf[6] = SUMMARY_SIZE;
+	put32(buf + 8, sum.num_mtls);
+	put32(buf + 12, sum.num_meshes);
+	put32(buf + 16, sum.num_lights);
+	put32(buf + 20, sum.num_cameras);
+	put32(buf + 24, sum.num_nodes);
+	put32(buf + 28, sum.hash);
+	put64(buf + 32, sum.num_verts);
+	put64(buf + 40, sum.num_faces);
+	for(i=0; i<3; i++) {
+		putf(buf + 48 + i * 4, sum.bmin[i]);
+		putf(buf + 60 + i * 4, sum.bmax[i]);
+	}
+	/* no animation is stored as an empty range: start > end */
+	put64(buf + 72, sum.anim ? (int64_t)sum.tstart : 1);
+	put64(buf + 80, sum.anim ? (int64_t)sum.tend : 0);
+	put32(buf + 88, SUMMARY_CRC);
+
+	if(tsio->write(buf, sizeof buf, tsio->data) < (long)sizeof buf) {
+		return -1;
+	}
+	return 0;
+}
+
+size_t g3dimpl_read_summary(const void *data, size_t size, struct goat3d_summary *sum,
+		unsigned int *flags)
+{
+	int i;
+	size_t blksz;
+	int64_t tstart, tend;
+	const unsigned char *buf = data;
+
+	if(size < SUMMARY_MIN || memcmp(buf, SUMMARY_MAGIC, 4) != 0) {
+		return 0;
+	}
+	blksz = buf[6] | ((size_t)buf[7] << 8);
+	if(blksz < SUMMARY_MIN || (buf[4] | buf[5]) == 0) {
+		return 0;
+	}
+	if(flags) *flags = get32(buf + 88);
+	if(!sum) return blksz;
+
+	memset(sum, 0, sizeof *sum);
+	sum->num_mtls = get32(buf + 8);
+	sum->num_meshes = get32(buf + 12);
+	sum->num_lights = get32(buf + 16);
+	sum->num_cameras = get32(buf + 20);
+	sum->num_nodes = get32(buf + 24);
+	sum->hash = get32(buf + 28);
+	sum->num_verts = (size_t)get64(buf + 32);
+	sum->num_faces = (size_t)get64(buf + 40);
+	for(i=0; i<3; i++) {
+		sum->bmin[i] = getf(buf + 48 + i * 4);
+		sum->bmax[i] = getf(buf + 60 + i * 4);
+	}
+	tstart = (int64_t)get64(buf + 72);
+	tend = (int64_t)get64(buf + 80);
+	if(tstart <= tend) {
+		sum->anim = 1;
+		sum->tstart = (long)tstart;
+		sum->tend = (long)tend;
+	}
+	return blksz;
+}
+
+int g3dimpl_write_trailer(uint32_t crc, uint64_t size, struct ts_io *tsio)
+{
+	unsigned char buf[TRAILER_SIZE];
+
+	memcpy(buf, TRAILER_MAGIC, 4);
+	put32(buf + 4, crc);
+	put64(buf + 8, size);
+
+	if(tsio->write(buf, sizeof buf, tsio->data) < (long)sizeof buf) {
+		return -1;
+	}
+	return 0;
+}
+
+int g3dimpl_check_trailer(const void *data, size_t size)
+{
+	const unsigned char *tr;
+
+	if(size < TRAILER_SIZE) {
+		goat3d_logmsg(LOG_ERROR, "truncated file, checksum missing\n");
+		return -1;
+	}
+	size -= TRAILER_SIZE;
+	tr = (const unsigned char*)data + size;
+
+	if(memcmp(tr, TRAILER_MAGIC, 4) != 0 || get64(tr + 8) != size) {
+		goat3d_logmsg(LOG_ERROR, "truncated or corrupted file, invalid checksum trailer\n");
+		return -1;
+	}
+	if(get32(tr + 4) != g3dimpl_crc32c(0, data, size)) {
+		goat3d_logmsg(LOG_ERROR, "checksum mismatch, the file is corrupted\n");
+		return -1;
+	}
+	return 0;
+}
+
+int g3dimpl_verify_file(struct goat3d_io *io)
+{
+	unsigned char hdr[SUMMARY_MIN];
+	unsigned int flags;
+	size_t sz = 0;
+	long rd;
+	struct crcreader cr;
+
+	while(sz < sizeof hdr && (rd = io->read(hdr + sz, sizeof hdr - sz, io->cls)) > 0) {
+		sz += rd;
+	}
+
+	if(g3dimpl_read_summary(hdr, sz, 0, &flags) == 0 || !(flags & SUMMARY_CRC)) {
+		goat3d_logmsg(LOG_INFO, "not a binary scene with a checksum, nothing to verify\n");
+		return 1;
+	}
+
+	if(g3dimpl_crcreader_open(&cr, io, 1, hdr, sz) == -1) {
+		return -1;
+	}
+	return g3dimpl_crcreader_close(&cr);
+}
+
+int g3dimpl_crcreader_open(struct crcreader *cr, struct goat3d_io *io, int check,
+		const void *hdr, size_t hdrsz)
+{
+	memset(cr, 0, sizeof *cr);
+	cr->io = io;
+	cr->check = check;
+
+	if((cr->size = goat3d_get_io_block_size()) < VERIFY_BUF_SIZE) {
+		cr->size = VERIFY_BUF_SIZE;
+	}
+	if(cr->size < hdrsz) {
+		cr->size = hdrsz;
+	}
+	if(!(cr->buf = g3dimpl_malloc(cr->size + TRAILER_SIZE))) {
+		goat3d_logmsg(LOG_ERROR, "failed to allocate read buffer\n");
+		return -1;
+	}
+	memcpy(cr->buf, hdr, hdrsz);
+	cr->len = hdrsz;
+	return 0;
+}
+
+long g3dimpl_crcreader_read(void *buf, size_t bytes, void *uptr)
+{
+	struct crcreader *cr = uptr;
+	size_t n, done = 0;
+
+	while(done < bytes) {
+		if(!(n = crc_avail(cr))) {
+			if(cr->eof || cr->err || crc_refill(cr) <= 0) break;
+			continue;
+		}
+		if(n > bytes - done) n = bytes - done;
+
+		memcpy((char*)buf + done, cr->buf + cr->pos, n);
+		if(cr->check) {
+			cr->crc = g3dimpl_crc32c(cr->crc, cr->buf + cr->pos, n);
+		}
+		cr->pos += n;
+		cr->total += n;
+		done += n;
+	}
+
+	if(!done && cr->err) return -1;
+	return (long)done;
+}
+
+int g3dimpl_crcreader_close(struct crcreader *cr)
+{
+	int res = -1;
+	size_t n;
+	const unsigned char *tr;
+
+	if(!cr->check) {
+		if(cr->len > cr->pos && cr->io->seek) {
+			cr->io->seek(-(long)(cr->len - cr->pos), SEEK_CUR, cr->io->cls);
+		}
+		g3dimpl_free(cr->buf);
+		cr->buf = 0;
+		return 0;
+	}
+
+	/* anything the parser left unread is still covered by the checksum */
+	for(;;) {
+		if((n = crc_avail(cr))) {
+			cr->crc = g3dimpl_crc32c(cr->crc, cr->buf + cr->pos, n);
+			cr->pos += n;
+			cr->total += n;
+			continue;
+		}
+		if(cr->eof || cr->err || crc_refill(cr) <= 0) break;
+	}
+
+	tr = cr->buf + cr->pos;
+	if(cr->err) {
+		goat3d_logmsg(LOG_ERROR, "read error while checking the checksum\n");
+	} else if(cr->len - cr->pos < TRAILER_SIZE || memcmp(tr, TRAILER_MAGIC, 4) != 0 ||
+			get64(tr + 8) != cr->total) {
+		goat3d_logmsg(LOG_ERROR, "truncated or corrupted file, invalid checksum trailer\n");
+	} else if(get32(tr + 4) != cr->crc) {
+		goat3d_logmsg(LOG_ERROR, "checksum mismatch, the file is corrupted\n");
+	} else {
+		res = 0;
+	}
+
+	g3dimpl_free(cr->buf);
+	cr->buf = 0;
+	return res;
+}
+
+/* the trailer can't be told apart from the data before reaching the end of
+ * the stream, so the last TRAILER_SIZE bytes in the buffer are held back
+ */
+static size_t crc_avail(const struct crcreader *cr)
+{
+	size_t n = cr->len - cr->pos;
+
+	if(cr->check) {
+		return n > TRAILER_SIZE ? n - TRAILER_SIZE : 0;
+	}
+	return n;
+}
+
+/* only called when nothing is available, so at most the held back trailer
+ * bytes are left in the buffer
+ */
+static long crc_refill(struct crcreader *cr)
+{
+	long rd;
+	size_t rem = cr->len - cr->pos;
+
+	memmove(cr->buf, cr->buf + cr->pos, rem);
+	cr->pos = 0;
+	cr->len = rem;
+
+	if((rd = cr->io->read(cr->buf + cr->len, cr->size + TRAILER_SIZE - cr->len, cr->io->cls)) < 0) {
+		cr->err = 1;
+	} else if(rd == 0) {
+		cr->eof = 1;
+	} else {
+		cr->len += rd;
+	}
+	return rd;
+}
+
+/* content hash: CRC32C of the vertex attribute and face arrays of all meshes,
+ * in order. Doesn't depend on the file format, so it identifies the same
+ * geometry saved as text or binary.
+ */
+static uint32_t mesh_hash(uint32_t crc, const struct goat3d_mesh *mesh)
+{
+	crc = g3dimpl_crc32c(crc, mesh->vertices, dynarr_size(mesh->vertices) * sizeof *mesh->vertices);
+	crc = g3dimpl_crc32c(crc, mesh->normals, dynarr_size(mesh->normals) * sizeof *mesh->normals);
+	crc = g3dimpl_crc32c(crc, mesh->tangents, dynarr_size(mesh->tangents) * sizeof *mesh->tangents);
+	crc = g3dimpl_crc32c(crc, mesh->texcoords, dynarr_size(mesh->texcoords) * sizeof *mesh->texcoords);
+	crc = g3dimpl_crc32c(crc, mesh->skin_weights, dynarr_size(mesh->skin_weights) * sizeof *mesh->skin_weights);
+	crc = g3dimpl_crc32c(crc, mesh->skin_matrices, dynarr_size(mesh->skin_matrices) * sizeof *mesh->skin_matrices);
+	crc = g3dimpl_crc32c(crc, mesh->colors, dynarr_size(mesh->colors) * sizeof *mesh->colors);
+	crc = g3dimpl_crc32c(crc, mesh->faces, dynarr_size(mesh->faces) * sizeof *mesh->faces);
+	return crc;
+}
+
+static void put32(unsigned char *p, uint32_t x)
+{
+	p[0] = x & 0xff;
+	p[1] = (x >> 8) & 0xff;
+	p[2] = (x >> 16) & 0xff;
+	p[3] = x >> 24;
+}
+
+static void put64(unsigned char *p, uint64_t x)
+{
+	put32(p, (uint32_t)x);
+	put32(p + 4, (uint32_t)(x >> 32));
+}
+
+static void putf(unsigned char *p, float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof bits);
+	put32(p, bits);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+	return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static float getf(const unsigned char *p)
+{
+	float x;
+	uint32_t bits = get32(p);
+	memcpy(&x, &bits, sizeof x);
+	return x;
+}
@@ -0,0 +1,82 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GOAT3D_SUMMARY_H_
+#define GOAT3D_SUMMARY_H_
+
+#include "goat3d.h"
+#include "crc32c.h"
+
+/* binary scene files are laid out as: the summary block, the treestore data,
+ * and a checksum trailer if the summary has SUMMARY_CRC set. The trailer is a
+ * "G3DC" magic, the CRC32C of everything before the trailer (32bit), and the
+ * size of everything before the trailer (64bit), little endian.
+ */
+#define SUMMARY_CRC		1	/* summary flag: the file ends with a checksum trailer */
+#define SUMMARY_MIN		92	/* bytes needed by g3dimpl_read_summary */
+#define TRAILER_SIZE	16
+
+struct ts_io;
+
+/* writes the summary block ahead of a binary scene, with SUMMARY_CRC set */
+int g3dimpl_write_summary(const struct goat3d *g, struct ts_io *tsio);
+/* returns the size of the summary block at the start of data, or 0 if there
+ * isn't one. sum and flags may be null.
+ */
+size_t g3dimpl_read_summary(const void *data, size_t size, struct goat3d_summary *sum,
+		unsigned int *flags);
+
+int g3dimpl_write_trailer(uint32_t crc, uint64_t size, struct ts_io *tsio);
+/* checks the trailer at the end of a whole binary scene in memory, returns 0
+ * if the checksum matches, -1 otherwise
+ */
+int g3dimpl_check_trailer(const void *data, size_t size);
+
+/* buffered reader for streaming binary scenes, which checksums everything
+ * read through it. With check set, the last TRAILER_SIZE bytes of the stream
+ * are held back as the trailer, and checked by g3dimpl_crcreader_close.
+ */
+struct crcreader {
+	struct goat3d_io *io;
+	unsigned char *buf;
+	size_t size;		/* block size, buf has room for the trailer on top */
+	size_t pos, len;	/* read position in buf, and valid bytes in buf */
+	int check, eof, err;
+	uint32_t crc;
+	uint64_t total;		/* bytes read through it (and checksummed) so far */
+};
+
+/* the first hdrsz bytes of the stream, already read by the caller, are passed
+ * in hdr, and read again through the crcreader first
+ */
+int g3dimpl_crcreader_open(struct crcreader *cr, struct goat3d_io *io, int check,
+		const void *hdr, size_t hdrsz);
+/* goat3d_io/ts_io compatible read callback, with the crcreader as closure */
+long g3dimpl_crcreader_read(void *buf, size_t bytes, void *uptr);
+/* with check set, reads the rest of the stream and checks the trailer,
+ * returning -1 if it doesn't match. Otherwise it returns the unread part of
+ * the read-ahead buffer to the stream if possible. Releases the buffer.
+ */
+int g3dimpl_crcreader_close(struct crcreader *cr);
+
+/* streams a binary scene with a checksum trailer through the checksum without
+ * parsing it. Returns 0 if the checksum matches, 1 if the file has no
+ * checksum, -1 on errors.
+ */
+int g3dimpl_verify_file(struct goat3d_io *io);
+
+#endif	/* GOAT3D_SUMMARY_H_ */
@@ -0,0 +1,825 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* dedicated parser for goat3d text scene files. It reads the treestore text
+ * syntax straight out of a memory buffer, without building a treestore tree,
+ * and mesh attribute lists go directly into the mesh arrays. Anything it
+ * doesn't understand is reported back to the caller, which falls back to the
+ * generic treestore loader.
+ */
+#include <string.h>
+#include "goat3d.h"
+#include "goat3d_impl.h"
+#include "log.h"
+#include "dynarr.h"
+#include "fmtnum.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+/* nesting limit for skipped nodes and values, they're skipped recursively */
+#define MAX_SKIP_DEPTH	64
+
+struct parser {
+	const char *start, *ptr, *end;
+	struct goat3d *g;
+	const char *err;	/* syntax error message */
+	int depth;			/* skip_node/skip_value nesting */
+};
+
+struct token {
+	const char *str;
+	int len;
+};
+
+/* material reference of a mesh, resolved after all materials are loaded */
+struct mtlref {
+	struct goat3d_mesh *mesh;
+	struct token name;	/* points into the text buffer */
+	int idx;			/* material index if name.str is null */
+};
+
+struct mesh_list {
+	const char *list, *item, *attr;
+	int attr_idx;		/* GOAT3D_MESH_ATTR_*, or -1 for faces */
+	int ncomp, isint;
+};
+
+static const struct mesh_list mesh_lists[] = {
+	{"vertex-list", "vertex", "pos", GOAT3D_MESH_ATTR_VERTEX, 3, 0},
+	{"normal-list", "normal", "dir", GOAT3D_MESH_ATTR_NORMAL, 3, 0},
+	{"tangent-list", "tangent", "dir", GOAT3D_MESH_ATTR_TANGENT, 3, 0},
+	{"texcoord-list", "texcoord", "uv", GOAT3D_MESH_ATTR_TEXCOORD, 2, 0},
+	{"skinweight-list", "skinweight", "weights", GOAT3D_MESH_ATTR_SKIN_WEIGHT, 4, 0},
+	{"skinmatrix-list", "skinmatrix", "idx", GOAT3D_MESH_ATTR_SKIN_MATRIX, 4, 1},
+	{"color-list", "color", "color", GOAT3D_MESH_ATTR_COLOR, 4, 0},
+	{"face-list", "face", "idx", -1, 3, 1},
+	{0, 0, 0, 0, 0, 0}
+};
+
+static int parse_mtl(struct parser *p, struct goat3d_material ***mtlarr);
+static int parse_mtl_attr(struct parser *p, struct goat3d_material *mtl);
+static int parse_mesh(struct parser *p, struct goat3d_mesh ***mesharr, struct mtlref **refs);
+static int parse_mesh_list(struct parser *p, struct goat3d_mesh *mesh, const struct mesh_list *ml);
+static void **mesh_array(struct goat3d_mesh *mesh, int attr_idx);
+static int skip_node(struct parser *p);
+static int skip_value(struct parser *p);
+static int enter(struct parser *p);
+static int parse_vec(struct parser *p, void *vec, int maxcomp, int isint);
+static int expect(struct parser *p, char c);
+static int next_ident(struct parser *p, struct token *tok);
+static int next_string(struct parser *p, struct token *tok);
+static int next_int(struct parser *p, int *res);
+static int next_float(struct parser *p, float *res);
+static char *tokdup(struct arena *arena, const struct token *tok);
+static void skip_space(struct parser *p);
+static void skip_space_slow(struct parser *p);
+
+#define TOKEQ(tok, s)	((tok).len == sizeof(s) - 1 && memcmp((tok).str, s, sizeof(s) - 1) == 0)
+
+static int tokeq(const struct token *tok, const char *s)
+{
+	return (int)strlen(s) == tok->len && memcmp(tok->str, s, tok->len) == 0;
+}
+
+/* returns 0 on success, -1 on failure or cancellation, and 1 if the text is
+ * not a scene this parser can handle. Objects are parsed into the scene arena
+ * and only added to g once the whole scene is parsed. If parsing fails, the
+ * arena is rolled back, releasing everything allocated for them.
+ */
+int g3dimpl_scnload_text(struct goat3d *g, const char *text, size_t size)
+{
+	int i, num, res = 1, added = 0;
+	struct arena_mark mark;
+	struct parser p;
+	struct token tok;
+	struct goat3d_material **mtls = 0;
+	struct goat3d_mesh **meshes = 0;
+	struct mtlref *refs = 0;
+	struct goat3d_material *mtl;
+	char *name;
+
+	p.start = p.ptr = text;
+	p.end = text + size;
+	p.g = g;
+	p.err = 0;
+	p.depth = 0;
+
+	skip_space(&p);
+	if(next_ident(&p, &tok) == -1 || !TOKEQ(tok, "scene") || expect(&p, '{') == -1) {
+		return 1;	/* not a text scene file */
+	}
+	g3dimpl_arena_mark(g->arena, &mark);
+
+	if(!(mtls = dynarr_alloc(0, sizeof *mtls)) || !(meshes = dynarr_alloc(0, sizeof *meshes)) ||
+			!(refs = dynarr_alloc(0, sizeof *refs))) {
+		goat3d_logmsg(LOG_ERROR, "g3dimpl_scnload_text: failed to allocate memory\n");
+		res = -1;
+		goto end;
+	}
+
+	for(;;) {
+		skip_space(&p);
+		if(p.ptr < p.end && *p.ptr == '}') {
+			p.ptr++;
+			break;
+		}
+		if(next_ident(&p, &tok) == -1) goto syntax;
+
+		skip_space(&p);
+		if(p.ptr < p.end && *p.ptr == '=') {
+			p.ptr++;
+			if(skip_value(&p) == -1) goto syntax;
+			continue;
+		}
+		if(expect(&p, '{') == -1) goto syntax;
+
+		if(TOKEQ(tok, "mtl")) {
+			res = parse_mtl(&p, &mtls);
+		} else if(TOKEQ(tok, "mesh")) {
+			res = parse_mesh(&p, &meshes, &refs);
+		} else {
+			/* nodes, lights and cameras aren't loaded yet */
+			res = skip_node(&p) == -1 ? 1 : 0;
+		}
+		if(res == 1) goto syntax;
+		if(res == -1) goto end;
+	}
+
+	skip_space(&p);
+	if(p.ptr < p.end) {
+		p.err = "garbage after the end of the scene";
+		goto syntax;
+	}
+
+	/* all parsed successfully, add everything to the scene */
+	added = 1;
+	num = dynarr_size(mtls);
+	for(i=0; i<num; i++) {
+		goat3d_add_mtl(g, mtls[i]);
+		if(g3dimpl_load_progress(g) == -1) {
+			res = -1;
+			goto end;
+		}
+	}
+
+	num = dynarr_size(refs);
+	for(i=0; i<num; i++) {
+		if(refs[i].name.str) {
+			if(!(name = tokdup(0, &refs[i].name))) {
+				continue;
+			}
+			mtl = goat3d_get_mtl_by_name(g, name);
+			g3dimpl_free(name);
+		} else {
+			mtl = refs[i].idx >= 0 && refs[i].idx < dynarr_size(mtls) ? mtls[refs[i].idx] : 0;
+		}
+		if(!mtl) {
+			goat3d_logmsg(LOG_WARNING, "mesh %s: material not found\n", refs[i].mesh->name);
+		}
+		refs[i].mesh->mtl = mtl;
+	}
+
+	num = dynarr_size(meshes);
+	for(i=0; i<num; i++) {
+		goat3d_add_mesh(g, meshes[i]);
+		if(g3dimpl_load_progress(g) == -1) {
+			res = -1;
+			goto end;
+		}
+	}
+	res = 0;
+	goto end;
+
+syntax:
+	{
+		int line = 1;
+		const char *s = p.start;
+		while((s = memchr(s, '\n', p.ptr - s))) {
+			line++;
+			s++;
+		}
+		/* the generic loader would recurse just as deep, don't hand it over */
+		if(p.depth > MAX_SKIP_DEPTH) {
+			goat3d_logmsg(LOG_ERROR, "text scene parser: %s at line %d\n", p.err, line);
+			res = -1;
+			goto end;
+		}
+		goat3d_logmsg(LOG_WARNING, "text scene parser: %s at line %d, falling back to the generic loader\n",
+				p.err ? p.err : "syntax error", line);
+	}
+	res = 1;
+
+end:
+	/* the objects themselves live in the scene arena */
+	dynarr_free(mtls);
+	dynarr_free(meshes);
+	dynarr_free(refs);
+	if(res != 0 && !added) {
+		/* nothing refers to the parsed objects, don't leave their memory,
+		 * which can be hundreds of MB of mesh data, pinned in the arena
+		 */
+		g3dimpl_arena_rollback(g->arena, &mark);
+	}
+	return res;
+}
+
+/* mtl { name = "..."; attr { name = "..."; val = [...]; map = "..." } } */
+static int parse_mtl(struct parser *p, struct goat3d_material ***mtlarr)
+{
+	struct goat3d_material *mtl, **tmp;
+	struct token tok, str;
+	int have_name = 0;
+	size_t num;
+
+	if(!(mtl = g3dimpl_arena_alloc(p->g->arena, sizeof *mtl)) || g3dimpl_mtl_init(mtl, p->g->arena) == -1) {
+		goat3d_logmsg(LOG_ERROR, "parse_mtl: failed to allocate material\n");
+		return -1;
+	}
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '}') {
+			p->ptr++;
+			break;
+		}
+		if(next_ident(p, &tok) == -1) return 1;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '=') {
+			p->ptr++;
+			if(TOKEQ(tok, "name")) {
+				if(next_string(p, &str) == -1) return 1;
+				if(str.len) {
+					g3dimpl_afree(mtl->arena, mtl->name);
+					if(!(mtl->name = tokdup(mtl->arena, &str))) {
+						goat3d_logmsg(LOG_ERROR, "parse_mtl: failed to allocate material name\n");
+						return -1;
+					}
+					have_name = 1;
+				}
+			} else {
+				if(skip_value(p) == -1) return 1;
+			}
+			continue;
+		}
+		if(expect(p, '{') == -1) return 1;
+
+		if(TOKEQ(tok, "attr")) {
+			if(parse_mtl_attr(p, mtl) == -1) return 1;
+		} else {
+			if(skip_node(p) == -1) return 1;
+		}
+	}
+
+	if(!have_name) {
+		goat3d_logmsg(LOG_WARNING, "parse_mtl: ignoring material without a name\n");
+		return 0;
+	}
+	if(dynarr_empty(mtl->attrib)) {
+		goat3d_logmsg(LOG_WARNING, "parse_mtl: ignoring empty material: %s\n", mtl->name);
+		return 0;
+	}
+
+	num = dynarr_size(*mtlarr);
+	tmp = dynarr_push(*mtlarr, &mtl);
+	if(dynarr_size(tmp) == num) {
+		goat3d_logmsg(LOG_ERROR, "parse_mtl: failed to add material\n");
+		return -1;
+	}
+	*mtlarr = tmp;
+	return 0;
+}
+
+static int parse_mtl_attr(struct parser *p, struct goat3d_material *mtl)
+{
+	struct token tok, name = {0, 0}, map = {0, 0};
+	cgm_vec4 value = {0, 0, 0, 1};
+	struct material_attrib *attr;
+	char namebuf[128];
+	int have_val = 0;
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '}') {
+			p->ptr++;
+			break;
+		}
+		if(next_ident(p, &tok) == -1) return -1;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '=') {
+			p->ptr++;
+			if(TOKEQ(tok, "name")) {
+				if(next_string(p, &name) == -1) return -1;
+			} else if(TOKEQ(tok, "map")) {
+				if(next_string(p, &map) == -1) return -1;
+			} else if(TOKEQ(tok, "val")) {
+				if(parse_vec(p, &value, 4, 0) == -1) return -1;
+				have_val = 1;
+			} else {
+				if(skip_value(p) == -1) return -1;
+			}
+			continue;
+		}
+		if(expect(p, '{') == -1 || skip_node(p) == -1) return -1;
+	}
+
+	if(!name.len || name.len >= (int)sizeof namebuf) {
+		return 0;	/* ignored, like in the treestore loader */
+	}
+	memcpy(namebuf, name.str, name.len);
+	namebuf[name.len] = 0;
+
+	if(!(attr = g3dimpl_mtl_getattr(mtl, namebuf))) {
+		goat3d_logmsg(LOG_ERROR, "parse_mtl_attr: failed to add attribute: %s\n", namebuf);
+		return 0;
+	}
+	if(have_val) {
+		attr->value = value;
+	} else {
+		cgm_wcons(&attr->value, 0, 0, 0, 0);
+	}
+	if(map.len && !(attr->map = tokdup(mtl->arena, &map))) {
+		goat3d_logmsg(LOG_ERROR, "parse_mtl_attr: failed to allocate map name\n");
+	}
+	return 0;
+}
+
+static int parse_mesh(struct parser *p, struct goat3d_mesh ***mesharr, struct mtlref **refs)
+{
+	struct goat3d_mesh *mesh, **tmp;
+	struct token tok, str;
+	struct mtlref ref, *tmpref;
+	const struct mesh_list *ml;
+	char *name;
+	int have_mtl = 0;
+	size_t num;
+
+	if(!(mesh = g3dimpl_arena_alloc(p->g->arena, sizeof *mesh)) ||
+			g3dimpl_obj_init((struct object*)mesh, OBJTYPE_MESH, p->g->arena) == -1) {
+		goat3d_logmsg(LOG_ERROR, "parse_mesh: failed to allocate mesh\n");
+		return -1;
+	}
+	ref.mesh = mesh;
+	ref.name.str = 0;
+	ref.name.len = 0;
+	ref.idx = -1;
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '}') {
+			p->ptr++;
+			break;
+		}
+		if(next_ident(p, &tok) == -1) return 1;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '=') {
+			p->ptr++;
+			if(TOKEQ(tok, "name")) {
+				if(next_string(p, &str) == -1) return 1;
+				if(!(name = tokdup(mesh->arena, &str))) {
+					goat3d_logmsg(LOG_ERROR, "parse_mesh: failed to allocate mesh name\n");
+					return -1;
+				}
+				mesh->name = name;
+			} else if(TOKEQ(tok, "material")) {
+				skip_space(p);
+				if(p->ptr < p->end && *p->ptr == '"') {
+					if(next_string(p, &ref.name) == -1) return 1;
+				} else {
+					if(next_int(p, &ref.idx) == -1) return 1;
+				}
+				have_mtl = 1;
+			} else {
+				if(skip_value(p) == -1) return 1;
+			}
+			continue;
+		}
+		if(expect(p, '{') == -1) return 1;
+
+		ml = mesh_lists;
+		while(ml->list && !tokeq(&tok, ml->list)) {
+			ml++;
+		}
+		if(ml->list) {
+			if(parse_mesh_list(p, mesh, ml) == -1) {
+				return p->err ? 1 : -1;
+			}
+		} else {
+			/* bone lists refer to nodes, which aren't loaded yet */
+			if(skip_node(p) == -1) return 1;
+		}
+	}
+
+	num = dynarr_size(*mesharr);
+	tmp = dynarr_push(*mesharr, &mesh);
+	if(dynarr_size(tmp) == num) {
+		goto nomem;
+	}
+	*mesharr = tmp;
+
+	if(have_mtl) {
+		num = dynarr_size(*refs);
+		tmpref = dynarr_push(*refs, &ref);
+		if(dynarr_size(tmpref) == num) {
+			goto nomem;
+		}
+		*refs = tmpref;
+	}
+	return 0;
+
+nomem:
+	goat3d_logmsg(LOG_ERROR, "parse_mesh: failed to add mesh\n");
+	return -1;
+}
+
+/* the hot path: list-size reserves the array, and every item value is parsed
+ * straight into a new array element. Returns -1 with p->err set on syntax
+ * errors, or with p->err null if we ran out of memory.
+ */
+static int parse_mesh_list(struct parser *p, struct goat3d_mesh *mesh, const struct mesh_list *ml)
+{
+	struct token tok;
+	void **arr, *tmp;
+	int count, itemlen, attrlen;
+	size_t size;
+	long maxcount;
+	union {
+		float f[4];
+		int i[4];
+	} elem;
+
+	arr = mesh_array(mesh, ml->attr_idx);
+	itemlen = strlen(ml->item);
+	attrlen = strlen(ml->attr);
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '}') {
+			p->ptr++;
+			return 0;
+		}
+		if(next_ident(p, &tok) == -1) return -1;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '=') {
+			p->ptr++;
+			if(TOKEQ(tok, "list-size")) {
+				if(next_int(p, &count) == -1) return -1;
+				/* it's only a hint, don't let it reserve more items than the
+				 * rest of the file can hold: at least "item{}" per item
+				 */
+				maxcount = (p->end - p->ptr) / (itemlen + 2);
+				if(count > maxcount) count = maxcount;
+				if(count > 0 && (tmp = dynarr_reserve(*arr, dynarr_size(*arr) + count))) {
+					*arr = tmp;
+				}
+			} else {
+				if(skip_value(p) == -1) return -1;
+			}
+			continue;
+		}
+		if(expect(p, '{') == -1) return -1;
+
+		if(tok.len != itemlen || memcmp(tok.str, ml->item, itemlen) != 0) {
+			if(skip_node(p) == -1) return -1;
+			continue;
+		}
+
+		/* list item */
+		memset(&elem, 0, sizeof elem);
+		if(ml->attr_idx == GOAT3D_MESH_ATTR_COLOR) {
+			elem.f[3] = 1.0f;
+		}
+		for(;;) {
+			skip_space(p);
+			if(p->ptr < p->end && *p->ptr == '}') {
+				p->ptr++;
+				break;
+			}
+			if(next_ident(p, &tok) == -1) return -1;
+
+			skip_space(p);
+			if(p->ptr < p->end && *p->ptr == '=') {
+				p->ptr++;
+				if(tok.len == attrlen && memcmp(tok.str, ml->attr, attrlen) == 0) {
+					if(parse_vec(p, &elem, ml->ncomp, ml->isint) == -1) return -1;
+				} else {
+					if(skip_value(p) == -1) return -1;
+				}
+				continue;
+			}
+			if(expect(p, '{') == -1 || skip_node(p) == -1) return -1;
+		}
+
+		size = dynarr_size(*arr);
+		tmp = dynarr_push(*arr, &elem);
+		if(dynarr_size(tmp) == size) {
+			goat3d_logmsg(LOG_ERROR, "parse_mesh_list: failed to grow %s of mesh %s\n", ml->list, mesh->name);
+			p->err = 0;
+			return -1;
+		}
+		*arr = tmp;
+	}
+}
+
+static void **mesh_array(struct goat3d_mesh *mesh, int attr_idx)
+{
+	switch(attr_idx) {
+	case GOAT3D_MESH_ATTR_VERTEX:
+		return (void**)&mesh->vertices;
+	case GOAT3D_MESH_ATTR_NORMAL:
+		return (void**)&mesh->normals;
+	case GOAT3D_MESH_ATTR_TANGENT:
+		return (void**)&mesh->tangents;
+	case GOAT3D_MESH_ATTR_TEXCOORD:
+		return (void**)&mesh->texcoords;
+	case GOAT3D_MESH_ATTR_SKIN_WEIGHT:
+		return (void**)&mesh->skin_weights;
+	case GOAT3D_MESH_ATTR_SKIN_MATRIX:
+		return (void**)&mesh->skin_matrices;
+	case GOAT3D_MESH_ATTR_COLOR:
+		return (void**)&mesh->colors;
+	default:
+		break;
+	}
+	return (void**)&mesh->faces;
+}
+
+/* nesting is only tracked on the way in: any error aborts the whole parse, and
+ * leaves depth past MAX_SKIP_DEPTH if it was caused by too deep nesting
+ */
+static int enter(struct parser *p)
+{
+	if(++p->depth > MAX_SKIP_DEPTH) {
+		p->err = "nesting too deep";
+		return -1;
+	}
+	return 0;
+}
+
+/* skips the rest of a node, after its opening brace */
+static int skip_node(struct parser *p)
+{
+	struct token tok;
+
+	if(enter(p) == -1) return -1;
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '}') {
+			p->ptr++;
+			p->depth--;
+			return 0;
+		}
+		if(next_ident(p, &tok) == -1) return -1;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == '=') {
+			p->ptr++;
+			if(skip_value(p) == -1) return -1;
+			continue;
+		}
+		if(expect(p, '{') == -1 || skip_node(p) == -1) return -1;
+	}
+}
+
+static int skip_value(struct parser *p)
+{
+	struct token tok;
+	float f;
+
+	skip_space(p);
+	if(p->ptr >= p->end) {
+		p->err = "unexpected end of file";
+		return -1;
+	}
+
+	switch(*p->ptr) {
+	case '"':
+		return next_string(p, &tok);
+
+	case '[':
+		p->ptr++;
+		if(enter(p) == -1) return -1;
+		for(;;) {
+			skip_space(p);
+			if(p->ptr < p->end && *p->ptr == ']') {
+				p->ptr++;
+				p->depth--;
+				return 0;
+			}
+			if(skip_value(p) == -1) return -1;
+			skip_space(p);
+			if(p->ptr < p->end && *p->ptr == ',') {
+				p->ptr++;
+			}
+		}
+
+	default:
+		break;
+	}
+
+	return next_float(p, &f);
+}
+
+/* parses a number or a vector of up to maxcomp numbers, extra components are
+ * ignored
+ */
+static int parse_vec(struct parser *p, void *vec, int maxcomp, int isint)
+{
+	int count = 0;
+	const char *end;
+	float *fvec = vec;
+	int *ivec = vec;
+	float fdummy;
+	int idummy;
+
+	skip_space(p);
+	if(p->ptr < p->end && *p->ptr != '[') {
+		end = isint ? g3dimpl_parse_int(p->ptr, p->end, ivec) : g3dimpl_parse_float(p->ptr, p->end, fvec);
+		if(!end) goto inval;
+		p->ptr = end;
+		return 0;
+	}
+	if(expect(p, '[') == -1) return -1;
+
+	for(;;) {
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == ']') {
+			p->ptr++;
+			return 0;
+		}
+		if(isint) {
+			end = g3dimpl_parse_int(p->ptr, p->end, count < maxcomp ? ivec + count : &idummy);
+		} else {
+			end = g3dimpl_parse_float(p->ptr, p->end, count < maxcomp ? fvec + count : &fdummy);
+		}
+		if(!end) goto inval;
+		p->ptr = end;
+		count++;
+
+		skip_space(p);
+		if(p->ptr < p->end && *p->ptr == ',') {
+			p->ptr++;
+		}
+	}
+
+inval:
+	p->err = "invalid number";
+	return -1;
+}
+
+static int expect(struct parser *p, char c)
+{
+	skip_space(p);
+	if(p->ptr >= p->end || *p->ptr != c) {
+		p->err = "unexpected character";
+		return -1;
+	}
+	p->ptr++;
+	return 0;
+}
+
+#define IS_IDENT(c) \
+	(((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9') || \
+	 (c) == '_' || (c) == '-' || (c) == '.')
+
+static int next_ident(struct parser *p, struct token *tok)
+{
+	const char *ptr;
+
+	skip_space(p);
+	ptr = p->ptr;
+	while(ptr < p->end && IS_IDENT(*ptr)) {
+		ptr++;
+	}
+	if(ptr == p->ptr) {
+		p->err = "expected a name";
+		return -1;
+	}
+	tok->str = p->ptr;
+	tok->len = ptr - p->ptr;
+	p->ptr = ptr;
+	return 0;
+}
+
+/* strings are borrowed from the text buffer, without copying */
+static int next_string(struct parser *p, struct token *tok)
+{
+	const char *qend;
+
+	if(expect(p, '"') == -1) {
+		p->err = "expected a string";
+		return -1;
+	}
+	if(!(qend = memchr(p->ptr, '"', p->end - p->ptr))) {
+		p->err = "unterminated string";
+		return -1;
+	}
+	tok->str = p->ptr;
+	tok->len = qend - p->ptr;
+	p->ptr = qend + 1;
+	return 0;
+}
+
+static int next_int(struct parser *p, int *res)
+{
+	const char *end;
+
+	skip_space(p);
+	if(!(end = g3dimpl_parse_int(p->ptr, p->end, res))) {
+		p->err = "expected an integer";
+		return -1;
+	}
+	p->ptr = end;
+	return 0;
+}
+
+static int next_float(struct parser *p, float *res)
+{
+	const char *end;
+
+	skip_space(p);
+	if(!(end = g3dimpl_parse_float(p->ptr, p->end, res))) {
+		p->err = "expected a number";
+		return -1;
+	}
+	p->ptr = end;
+	return 0;
+}
+
+static char *tokdup(struct arena *arena, const struct token *tok)
+{
+	char *s;
+
+	if(!(s = g3dimpl_aalloc(arena, tok->len + 1))) {
+		return 0;
+	}
+	memcpy(s, tok->str, tok->len);
+	s[tok->len] = 0;
+	return s;
+}
+
+/* skips whitespace (anything up to ' ') and # comments. Most calls land
+ * on a token already, and return right away without calling skip_space_slow,
+ * which skips runs of whitespace 16 bytes at a time with SSE2.
+ */
+static void skip_space(struct parser *p)
+{
+	if(p->ptr < p->end && ((unsigned char)*p->ptr <= ' ' || *p->ptr == '#')) {
+		skip_space_slow(p);
+	}
+}
+
+static void skip_space_slow(struct parser *p)
+{
+	const char *ptr = p->ptr, *end = p->end;
+
+	for(;;) {
+#ifdef USE_SSE2
+		if(end - ptr >= 16 && (unsigned char)*ptr <= ' ') {
+			__m128i spc = _mm_set1_epi8(' ');
+			while(end - ptr >= 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)ptr);
+				/* unsigned v <= ' ' iff max(v, ' ') == ' ' */
+				int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, spc), spc)) & 0xffff;
+				if(mask) {
+					ptr += __builtin_ctz(mask);
+					break;
+				}
+				ptr += 16;
+			}
+		}
+#endif
+		while(ptr < end && (unsigned char)*ptr <= ' ') {
+			ptr++;
+		}
+		if(ptr < end && *ptr == '#') {
+			if(!(ptr = memchr(ptr, '\n', end - ptr))) {
+				ptr = end;
+			}
+			continue;
+		}
+		break;
+	}
+	p->ptr = ptr;
+}
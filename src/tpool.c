@@ -0,0 +1,322 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "goat3d.h"
+#include "tpool.h"
+#include "alloc.h"
+#include "log.h"
+
+struct range {
+	int begin, end;
+	pthread_mutex_t lock;
+};
+
+static void init_pool(void);
+static int start_workers(int count);
+static void stop_workers(void);
+static int num_processors(void);
+static void *worker(void *arg);
+static void run_ranges(int id);
+static int steal(int id);
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+/* held by the thread running a parallel loop, for its duration */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int generation, busy_workers, quit;
+/* generation at the time the current workers were started */
+static int start_gen;
+
+static int num_workers;		/* not counting the thread calling parallel_for */
+/* worker count requested by goat3d_set_threads, -1 for one per processor */
+static int conf_workers = -1;
+static pthread_t *threads;
+static struct range *ranges;	/* num_workers + 1, the last one is the caller's */
+
+/* host application scheduler, replaces the pool if set */
+static goat3d_parallel_for_func sched_func;
+static void *sched_cls;
+
+static void (*task_func)(int, void*);
+static void *task_cls;
+
+
+int g3dimpl_parallel_for(int count, void (*func)(int, void*), void *cls)
+{
+	int i, nranges;
+
+	if(sched_func && count > 1) {
+		sched_func(count, func, cls, sched_cls);
+		return 0;
+	}
+
+	pthread_once(&init_once, init_pool);
+
+	if(count <= 1 || pthread_mutex_trylock(&pool_lock) != 0) {
+		goto serial;
+	}
+	/* goat3d_set_threads changes the worker count with pool_lock held */
+	if(num_workers <= 0) {
+		pthread_mutex_unlock(&pool_lock);
+		goto serial;
+	}
+
+	task_func = func;
+	task_cls = cls;
+
+	nranges = num_workers + 1;
+	for(i=0; i<nranges; i++) {
+		pthread_mutex_lock(&ranges[i].lock);
+		ranges[i].begin = (int)((long long)count * i / nranges);
+		ranges[i].end = (int)((long long)count * (i + 1) / nranges);
+		pthread_mutex_unlock(&ranges[i].lock);
+	}
+
+	pthread_mutex_lock(&work_lock);
+	busy_workers = num_workers;
+	generation++;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&work_lock);
+
+	run_ranges(num_workers);
+
+	pthread_mutex_lock(&work_lock);
+	while(busy_workers > 0) {
+		pthread_cond_wait(&done_cond, &work_lock);
+	}
+	pthread_mutex_unlock(&work_lock);
+
+	pthread_mutex_unlock(&pool_lock);
+	return 0;
+
+serial:
+	for(i=0; i<count; i++) {
+		func(i, cls);
+	}
+	return 0;
+}
+
+GOAT3DAPI int goat3d_set_threads(int num_threads)
+{
+	int res;
+
+	pthread_once(&init_once, init_pool);
+
+	/* wait for any parallel loop in progress to finish */
+	pthread_mutex_lock(&pool_lock);
+	stop_workers();
+	conf_workers = num_threads > 0 ? num_threads - 1 : -1;
+	res = start_workers(conf_workers);
+	pthread_mutex_unlock(&pool_lock);
+	return res;
+}
+
+GOAT3DAPI void goat3d_set_scheduler(goat3d_parallel_for_func func, void *cls)
+{
+	pthread_once(&init_once, init_pool);
+
+	pthread_mutex_lock(&pool_lock);
+	sched_func = func;
+	sched_cls = cls;
+	/* idle workers would just be taking up resources */
+	if(func) {
+		stop_workers();
+	} else if(!num_workers) {
+		start_workers(conf_workers);
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
+
+static void init_pool(void)
+{
+	/* parallel_for sees the worker count after pthread_once returns */
+	start_workers(-1);
+}
+
+/* starts count worker threads, or one less than the number of processors if
+ * count is negative. Returns the number of workers started.
+ */
+static int start_workers(int count)
+{
+	int i;
+
+	if(count < 0) {
+		count = num_processors() - 1;
+	}
+	if(count <= 0) {
+		return 0;
+	}
+	if(!(ranges = g3dimpl_malloc((count + 1) * sizeof *ranges))) {
+		return -1;
+	}
+	if(!(threads = g3dimpl_malloc(count * sizeof *threads))) {
+		g3dimpl_free(ranges);
+		ranges = 0;
+		return -1;
+	}
+	for(i=0; i<=count; i++) {
+		ranges[i].begin = ranges[i].end = 0;
+		pthread_mutex_init(&ranges[i].lock, 0);
+	}
+
+	/* workers might not get to run before the next parallel loop bumps the
+	 * generation, so they must not read it themselves when they start
+	 */
+	pthread_mutex_lock(&work_lock);
+	start_gen = generation;
+	pthread_mutex_unlock(&work_lock);
+
+	for(i=0; i<count; i++) {
+		if(pthread_create(threads + i, 0, worker, (void*)(long)i) != 0) {
+			goat3d_logmsg(LOG_WARNING, "thread pool: failed to create worker thread %d\n", i);
+			break;
+		}
+	}
+	if(i == 0) {
+		g3dimpl_free(ranges);
+		g3dimpl_free(threads);
+		ranges = 0;
+		threads = 0;
+	}
+	num_workers = i;
+	return i;
+}
+
+static int num_processors(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+/* called with pool_lock held, so no parallel loop is running */
+static void stop_workers(void)
+{
+	int i;
+
+	if(!num_workers) return;
+
+	pthread_mutex_lock(&work_lock);
+	quit = 1;
+	pthread_cond_broadcast(&work_cond);
+	pthread_mutex_unlock(&work_lock);
+
+	for(i=0; i<num_workers; i++) {
+		pthread_join(threads[i], 0);
+	}
+	quit = 0;
+
+	g3dimpl_free(ranges);
+	g3dimpl_free(threads);
+	ranges = 0;
+	threads = 0;
+	num_workers = 0;
+}
+
+static void *worker(void *arg)
+{
+	int gen, id = (int)(long)arg;
+
+	pthread_mutex_lock(&work_lock);
+	gen = start_gen;
+	for(;;) {
+		while(gen == generation && !quit) {
+			pthread_cond_wait(&work_cond, &work_lock);
+		}
+		if(quit) break;
+		gen = generation;
+		pthread_mutex_unlock(&work_lock);
+
+		run_ranges(id);
+
+		pthread_mutex_lock(&work_lock);
+		if(--busy_workers == 0) {
+			pthread_cond_signal(&done_cond);
+		}
+	}
+	pthread_mutex_unlock(&work_lock);
+	return 0;
+}
+
+static void run_ranges(int id)
+{
+	int idx;
+	struct range *r = ranges + id;
+
+	for(;;) {
+		pthread_mutex_lock(&r->lock);
+		idx = r->begin < r->end ? r->begin++ : -1;
+		pthread_mutex_unlock(&r->lock);
+
+		if(idx >= 0) {
+			task_func(idx, task_cls);
+		} else if(!steal(id)) {
+			break;
+		}
+	}
+}
+
+/* steals the upper half of the largest remaining range of another thread */
+static int steal(int id)
+{
+	int i, n, victim = -1, max_left = 0, begin, end;
+
+	for(i=0; i<=num_workers; i++) {
+		if(i == id) continue;
+		pthread_mutex_lock(&ranges[i].lock);
+		n = ranges[i].end - ranges[i].begin;
+		pthread_mutex_unlock(&ranges[i].lock);
+		if(n > max_left) {
+			max_left = n;
+			victim = i;
+		}
+	}
+	if(victim == -1) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&ranges[victim].lock);
+	n = ranges[victim].end - ranges[victim].begin;
+	if(n <= 0) {
+		pthread_mutex_unlock(&ranges[victim].lock);
+		return 1;	/* someone beat us to it, try again */
+	}
+	end = ranges[victim].end;
+	begin = ranges[victim].begin + n / 2;
+	ranges[victim].end = begin;
+	pthread_mutex_unlock(&ranges[victim].lock);
+
+	pthread_mutex_lock(&ranges[id].lock);
+	ranges[id].begin = begin;
+	ranges[id].end = end;
+	pthread_mutex_unlock(&ranges[id].lock);
+	return 1;
+}
@@ -0,0 +1,33 @@
+/*
+goat3d - 3D scene, and animation file format library.
+Copyright (C) 2013-2018  John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TPOOL_H_
+#define TPOOL_H_
+
+/* runs func(i, cls) for every i in [0, count), spread across the worker threads
+ * of the library thread pool and the calling thread. Each thread starts on a
+ * contiguous range of indices, and when it runs out, steals the upper half of
+ * the largest range remaining in another thread.
+ * Falls back to a plain loop in the calling thread if threads are unavailable,
+ * or the pool is already busy (nested or concurrent parallel loops).
+ * Every parallel operation in the library goes through this, so that they all
+ * share the same workers (see goat3d_set_threads), or the host application
+ * scheduler if one is set (see goat3d_set_scheduler).
+ */
+int g3dimpl_parallel_for(int count, void (*func)(int, void*), void *cls);
+
+#endif	/* TPOOL_H_ */
@@ -17,15 +17,39 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <treestore.h>
 #include "goat3d_impl.h"
 #include "log.h"
 #include "dynarr.h"
+#include "g3danm.h"
+#include "bufio.h"
+#include "fmtnum.h"
+#include "summary.h"
+
+/* keyframe reduction tolerances for compressed animations. The vector
+ * tolerance is relative to the extent of the track values, if it's over 1.
+ */
+#define ANM_VEC_TOL		1e-4f
+#define ANM_ROT_TOL		1e-4f
 
 static struct ts_node *create_mtltree(const struct goat3d_material *mtl);
 static struct ts_node *create_meshtree(const struct goat3d_mesh *mesh);
 static struct ts_node *create_lighttree(const struct goat3d_light *light);
 static struct ts_node *create_camtree(const struct goat3d_camera *cam);
+static int create_tracktree(struct ts_node *tsanim, struct goat3d_node *node, int attr, int compress);
+static int save_tree(struct ts_node *tsroot, struct goat3d_io *io, int text);
+static int write_tree(struct ts_node *tsroot, struct ts_io *tsio, int text);
+static int write_text_node(struct ts_node *node, int level, struct ts_io *tsio);
+static int write_text_value(struct ts_value *val, struct ts_io *tsio);
+static long write_crc(const void *buf, size_t bytes, void *uptr);
+
+/* checksums everything written through it, for the binary scene trailer */
+struct crcwriter {
+	struct ts_io *io;
+	uint32_t crc;
+	uint64_t size;
+};
 
 #define create_tsnode(n, p, nstr) \
 	do { \
@@ -34,7 +58,7 @@ static struct ts_node *create_camtree(const struct goat3d_camera *cam);
 			goat3d_logmsg(LOG_ERROR, "%s: failed to create treestore node\n", __func__); \
 			goto err; \
 		} \
-		if(!((n)->name = malloc(len + 1))) { \
+		if(!((n)->name = malloc(len + 1))) {	/* freed by treestore */ \
 			goat3d_logmsg(LOG_ERROR, "%s: failed to allocate node name string\n", __func__); \
 			ts_free_node(n); \
 			goto err; \
@@ -66,15 +90,30 @@ static struct ts_node *create_camtree(const struct goat3d_camera *cam);
 
 int g3dimpl_scnsave(const struct goat3d *g, struct goat3d_io *io)
 {
-	int i, num;
+	int res;
 	struct ts_io tsio;
+	struct bufio bio;
+
+	g3dimpl_bufio_open(&bio, io);
+	tsio.data = &bio;
+	tsio.read = g3dimpl_bufio_read;
+	tsio.write = g3dimpl_bufio_write;
+
+	res = g3dimpl_scnsave_tsio(g, &tsio);
+	if(g3dimpl_bufio_close(&bio) == -1) {
+		res = -1;
+	}
+	return res;
+}
+
+int g3dimpl_scnsave_tsio(const struct goat3d *g, struct ts_io *tsio)
+{
+	int i, num, res;
+	struct crcwriter cw;
+	struct ts_io crcio;
 	struct ts_node *tsroot = 0, *tsn, *tsenv;
 	struct ts_attr *tsa;
 
-	tsio.data = io->cls;
-	tsio.read = io->read;
-	tsio.write = io->write;
-
 	create_tsnode(tsroot, 0, "scene");
 
 	/* environment */
@@ -117,10 +156,28 @@ int g3dimpl_scnsave(const struct goat3d *g, struct goat3d_io *io)
 
 	/* TODO nodes */
 
-	if(ts_save_io(tsroot, &tsio) == -1) {
+	if(goat3d_getopt(g, GOAT3D_OPT_SAVETEXT)) {
+		res = write_tree(tsroot, tsio, 1);
+	} else {
+		/* summary block, treestore data, and checksum trailer */
+		cw.io = tsio;
+		cw.crc = 0;
+		cw.size = 0;
+		crcio.data = &cw;
+		crcio.read = 0;
+		crcio.write = write_crc;
+
+		if((res = g3dimpl_write_summary(g, &crcio)) != -1) {
+			if((res = write_tree(tsroot, &crcio, 0)) != -1) {
+				res = g3dimpl_write_trailer(cw.crc, cw.size, tsio);
+			}
+		}
+	}
+	if(res == -1) {
 		goat3d_logmsg(LOG_ERROR, "g3dimpl_scnsave: failed\n");
 		goto err;
 	}
+	ts_free_tree(tsroot);
 	return 0;
 
 err:
@@ -130,9 +187,188 @@ err:
 
 int g3dimpl_anmsave(const struct goat3d *g, struct goat3d_io *io)
 {
+	int i, j, num, compress;
+	struct ts_node *tsroot = 0;
+	struct ts_attr *tsa;
+	const char *name = 0;
+
+	compress = goat3d_getopt(g, GOAT3D_OPT_ANIMCOMPRESS);
+
+	create_tsnode(tsroot, 0, "anim");
+
+	num = dynarr_size(g->nodes);
+	for(i=0; i<num; i++) {
+		struct goat3d_node *node = g->nodes[i];
+		if(!name && !node->anm.parent) {
+			name = goat3d_get_anim_name(node);
+		}
+		for(j=0; j<3; j++) {
+			if(create_tracktree(tsroot, node, j, compress) == -1) {
+				goto err;
+			}
+		}
+	}
+
+	if(name) {
+		create_tsattr(tsa, tsroot, "name", TS_STRING);
+		if(ts_set_value_str(&tsa->val, name) == -1) {
+			goto err;
+		}
+	}
+
+	if(save_tree(tsroot, io, goat3d_getopt(g, GOAT3D_OPT_SAVETEXT)) == -1) {
+		goat3d_logmsg(LOG_ERROR, "g3dimpl_anmsave: failed\n");
+		goto err;
+	}
+	ts_free_tree(tsroot);
+	return 0;
+
+err:
+	ts_free_tree(tsroot);
 	return -1;
 }
 
+/* writes the tree through a buffering layer, to coalesce the many small
+ * writes done by treestore into a few large ones
+ */
+static int save_tree(struct ts_node *tsroot, struct goat3d_io *io, int text)
+{
+	int res;
+	struct ts_io tsio;
+	struct bufio bio;
+
+	g3dimpl_bufio_open(&bio, io);
+	tsio.data = &bio;
+	tsio.read = g3dimpl_bufio_read;
+	tsio.write = g3dimpl_bufio_write;
+
+	res = write_tree(tsroot, &tsio, text);
+	if(g3dimpl_bufio_close(&bio) == -1) {
+		res = -1;
+	}
+	return res;
+}
+
+static int write_tree(struct ts_node *tsroot, struct ts_io *tsio, int text)
+{
+	if(text) {
+		return write_text_node(tsroot, 0, tsio);
+	}
+	return ts_save_io(tsroot, tsio);
+}
+
+static long write_crc(const void *buf, size_t bytes, void *uptr)
+{
+	struct crcwriter *cw = uptr;
+	long res = cw->io->write(buf, bytes, cw->io->data);
+
+	if(res > 0) {
+		cw->crc = g3dimpl_crc32c(cw->crc, buf, res);
+		cw->size += res;
+	}
+	return res;
+}
+
+#define WRITE_STR(io, s, len) \
+	do { \
+		if((io)->write((s), (len), (io)->data) < (long)(len)) return -1; \
+	} while(0)
+
+/* text output in the treestore text syntax, with our own number formatting:
+ * shortest round-trip floats, no locale lookups, and no allocations.
+ */
+static int write_text_node(struct ts_node *node, int level, struct ts_io *tsio)
+{
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	int ind = level < (int)sizeof tabs - 1 ? level : (int)sizeof tabs - 1;
+	struct ts_attr *attr;
+	struct ts_node *c;
+
+	WRITE_STR(tsio, tabs, ind);
+	WRITE_STR(tsio, node->name, strlen(node->name));
+	WRITE_STR(tsio, " {\n", 3);
+
+	attr = node->attr_list;
+	while(attr) {
+		WRITE_STR(tsio, tabs, ind + 1);
+		WRITE_STR(tsio, attr->name, strlen(attr->name));
+		WRITE_STR(tsio, " = ", 3);
+		if(write_text_value(&attr->val, tsio) == -1) {
+			return -1;
+		}
+		WRITE_STR(tsio, "\n", 1);
+		attr = attr->next;
+	}
+
+	c = node->child_list;
+	while(c) {
+		if(write_text_node(c, level + 1, tsio) == -1) {
+			return -1;
+		}
+		c = c->next;
+	}
+
+	WRITE_STR(tsio, tabs, ind);
+	WRITE_STR(tsio, "}\n", 2);
+	return 0;
+}
+
+/* vectors are formatted a few components at a time into a stack buffer */
+#define VEC_BATCH	4
+
+static int write_text_value(struct ts_value *val, struct ts_io *tsio)
+{
+	int i, len, count;
+	char buf[VEC_BATCH * (FMT_FLOAT_MAX + 2)];
+
+	switch(val->type) {
+	case TS_NUMBER:
+		if((float)val->inum == val->fnum) {
+			len = g3dimpl_fmt_int(buf, val->inum);
+		} else {
+			len = g3dimpl_fmt_float(buf, val->fnum);
+		}
+		WRITE_STR(tsio, buf, len);
+		break;
+
+	case TS_VECTOR:
+		WRITE_STR(tsio, "[", 1);
+		for(i=0; i<val->vec_size; i+=VEC_BATCH) {
+			count = val->vec_size - i;
+			if(count > VEC_BATCH) count = VEC_BATCH;
+
+			len = 0;
+			if(i) {
+				buf[len++] = ',';
+				buf[len++] = ' ';
+			}
+			len += g3dimpl_fmt_floatv(buf + len, val->vec + i, count);
+			WRITE_STR(tsio, buf, len);
+		}
+		WRITE_STR(tsio, "]", 1);
+		break;
+
+	case TS_ARRAY:
+		WRITE_STR(tsio, "[", 1);
+		for(i=0; i<val->array_size; i++) {
+			if(i) WRITE_STR(tsio, ", ", 2);
+			if(write_text_value(val->array + i, tsio) == -1) {
+				return -1;
+			}
+		}
+		WRITE_STR(tsio, "]", 1);
+		break;
+
+	default:
+		WRITE_STR(tsio, "\"", 1);
+		if(val->str) {
+			WRITE_STR(tsio, val->str, strlen(val->str));
+		}
+		WRITE_STR(tsio, "\"", 1);
+	}
+	return 0;
+}
+
 static struct ts_node *create_mtltree(const struct goat3d_material *mtl)
 {
 	int i, num_attr;
@@ -394,3 +630,134 @@ err:
 	ts_free_tree(tscam);
 	return 0;
 }
+
+/* adds a track for the position, rotation, or scaling of the active animation
+ * of a node, if it has any keyframes
+ */
+static int create_tracktree(struct ts_node *tsanim, struct goat3d_node *node, int attr, int compress)
+{
+	int i, num, res, rot = attr == ROTATION_TRACK;
+	struct key *keys = 0;
+	struct anm_animation *anim;
+	struct anm_track *trk;
+	struct ts_node *tstrk = 0, *tskey;
+	struct ts_attr *tsa;
+	char *packed;
+	cgm_vec3 vmin, vmax;
+
+	switch(attr) {
+	case POSITION_TRACK:
+		num = goat3d_get_node_position_key_count(node);
+		break;
+	case ROTATION_TRACK:
+		num = goat3d_get_node_rotation_key_count(node);
+		break;
+	default:
+		num = goat3d_get_node_scaling_key_count(node);
+	}
+	if(num <= 0 || !(anim = anm_get_active_animation(&node->anm, 0))) {
+		return 0;
+	}
+	trk = anim->tracks + g3dimpl_track_base[attr];
+
+	if(!(keys = g3dimpl_malloc(num * sizeof *keys))) {
+		goat3d_logmsg(LOG_ERROR, "%s: failed to allocate keyframe array\n", __func__);
+		return -1;
+	}
+	for(i=0; i<num; i++) {
+		cgm_vec4 *v = &keys[i].val;
+		v->w = 1.0f;
+		switch(attr) {
+		case POSITION_TRACK:
+			keys[i].tm = goat3d_get_node_position_key(node, i, &v->x, &v->y, &v->z);
+			break;
+		case ROTATION_TRACK:
+			keys[i].tm = goat3d_get_node_rotation_key(node, i, &v->x, &v->y, &v->z, &v->w);
+			break;
+		default:
+			keys[i].tm = goat3d_get_node_scaling_key(node, i, &v->x, &v->y, &v->z);
+		}
+	}
+
+	create_tsnode(tstrk, 0, "track");
+	create_tsattr(tsa, tstrk, "node", TS_STRING);
+	if(ts_set_value_str(&tsa->val, goat3d_get_node_name(node)) == -1) {
+		goto err;
+	}
+	create_tsattr(tsa, tstrk, "attr", TS_STRING);
+	if(ts_set_value_str(&tsa->val, g3dimpl_track_attr_names[attr]) == -1) {
+		goto err;
+	}
+	create_tsattr(tsa, tstrk, "interp", TS_STRING);
+	if(ts_set_value_str(&tsa->val, g3dimpl_interp_names[trk->interp]) == -1) {
+		goto err;
+	}
+	create_tsattr(tsa, tstrk, "extrap", TS_STRING);
+	if(ts_set_value_str(&tsa->val, g3dimpl_extrap_names[trk->extrap]) == -1) {
+		goto err;
+	}
+
+	if(compress) {
+		float tol = ANM_ROT_TOL;
+		if(!rot) {
+			float extent = 1.0f;
+			for(i=0; i<num; i++) {
+				float *v = &keys[i].val.x;
+				int j;
+				for(j=0; j<3; j++) {
+					float d = fabs(v[j] - (&keys[0].val.x)[j]);
+					if(d > extent) extent = d;
+				}
+			}
+			tol = ANM_VEC_TOL * extent;
+		}
+		/* the fit test assumes linear/slerp interpolation, dropping keys
+		 * from step or cubic tracks would change their playback
+		 */
+		if(trk->interp == ANM_INTERP_LINEAR) {
+			num = g3dimpl_reduce_keys(keys, num, rot, tol);
+		}
+
+		if(!(packed = g3dimpl_pack_keys(keys, num, rot, &vmin, &vmax))) {
+			goat3d_logmsg(LOG_ERROR, "%s: failed to pack keyframes\n", __func__);
+			goto err;
+		}
+		create_tsattr(tsa, tstrk, "key-count", TS_NUMBER);
+		ts_set_valuei(&tsa->val, num);
+		if(!rot) {
+			create_tsattr(tsa, tstrk, "range-min", TS_VECTOR);
+			ts_set_valuefv(&tsa->val, 3, vmin.x, vmin.y, vmin.z);
+			create_tsattr(tsa, tstrk, "range-max", TS_VECTOR);
+			ts_set_valuefv(&tsa->val, 3, vmax.x, vmax.y, vmax.z);
+		}
+		create_tsattr(tsa, tstrk, "keys", TS_STRING);
+		res = ts_set_value_str(&tsa->val, packed);
+		g3dimpl_free(packed);
+		if(res == -1) {
+			goto err;
+		}
+
+	} else {
+		for(i=0; i<num; i++) {
+			cgm_vec4 *v = &keys[i].val;
+			create_tsnode(tskey, tstrk, "key");
+			create_tsattr(tsa, tskey, "time", TS_NUMBER);
+			ts_set_valuei(&tsa->val, keys[i].tm);
+			create_tsattr(tsa, tskey, "value", TS_VECTOR);
+			if(rot) {
+				ts_set_valuefv(&tsa->val, 4, v->x, v->y, v->z, v->w);
+			} else {
+				ts_set_valuefv(&tsa->val, 3, v->x, v->y, v->z);
+			}
+		}
+	}
+
+	g3dimpl_free(keys);
+	ts_add_child(tsanim, tstrk);
+	return 0;
+
+err:
+	g3dimpl_free(keys);
+	ts_free_tree(tstrk);
+	return -1;
+}